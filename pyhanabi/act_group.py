@@ -29,6 +29,9 @@ class ActGroup:
         gamma,
         convention,
         convention_act_override,
+        act_batchsize=5000,
+        priority_batchsize=100,
+        target_batchsize=5000,
     ):
         self.devices = devices.split(",")
         self.seed = seed
@@ -37,23 +40,34 @@ class ActGroup:
         self.num_game_per_thread = num_game_per_thread
         self.explore_eps = explore_eps
         self.trinary = trinary
-        self.replay_buffer = replay_buffer
         self.max_len = max_len
         self.gamma = gamma
 
-        self.load_partner_model(partner_weight)
-
+        # several partners: thread i plays with partner i % #partner and
+        # stores its games in replay_buffer[i % #partner]
+        if isinstance(partner_weight, str):
+            partner_weight = [partner_weight]
+        self._partners = [self.load_partner_model(w) for w in partner_weight]
+        if not isinstance(replay_buffer, list):
+            replay_buffer = [replay_buffer] * len(self._partners)
+        assert len(replay_buffer) == len(self._partners)
+        self.replay_buffers = replay_buffer
+
+        # [runner, partner_runner for each partner] per device
         self.model_runners = []
         for dev in self.devices:
             runner = rela.BatchRunner(agent.clone(dev), dev)
-            runner.add_method("act", 5000)
-            runner.add_method("compute_priority", 100)
-            runner.add_method("compute_target", 5000)
-
-            partner_runner = rela.BatchRunner(
-                    self._partner_agent.clone(dev), dev)
-            partner_runner.add_method("act", 5000)
-            self.model_runners.append([runner, partner_runner])
+            runner.add_method("act", act_batchsize)
+            runner.add_method("compute_priority", priority_batchsize)
+            runner.add_method("compute_target", target_batchsize)
+
+            runners = [runner]
+            for partner_agent, _, _ in self._partners:
+                partner_runner = rela.BatchRunner(
+                        partner_agent.clone(dev), dev)
+                partner_runner.add_method("act", act_batchsize)
+                runners.append(partner_runner)
+            self.model_runners.append(runners)
         self.num_runners = len(self.model_runners)
 
         self.convention = convention
@@ -73,15 +87,15 @@ class ActGroup:
 
         if "fc_v.weight" in state_dict.keys():
             agent, cfg = utils.load_agent(weight_file, overwrite)
-            self._partner_sad = cfg["sad"] if "sad" in cfg else cfg["greedy_extra"]
-            self._partner_hide_action = bool(cfg["hide_action"])
+            sad = cfg["sad"] if "sad" in cfg else cfg["greedy_extra"]
+            hide_action = bool(cfg["hide_action"])
         else:
             agent = utils.load_supervised_agent(weight_file, "cuda:0")
-            self._partner_sad = False
-            self._partner_hide_action = False
+            sad = False
+            hide_action = False
 
         agent.train(False)
-        self._partner_agent = agent
+        return agent, sad, hide_action
 
     def create_r2d2_actors(self):
         convention_act_override = [0, 0]
@@ -92,11 +106,14 @@ class ActGroup:
 
         actors = []
         for i in range(self.num_thread):
+            partner_idx = i % len(self._partners)
+            _, partner_sad, partner_hide_action = self._partners[partner_idx]
+            runners = self.model_runners[i % self.num_runners]
             thread_actors = []
             for j in range(self.num_game_per_thread):
                 game_actors = []
                 actor = hanalearn.R2D2Actor(
-                    self.model_runners[i % self.num_runners][0],
+                    runners[0],
                     self.seed,
                     self.num_player,
                     0,
@@ -107,7 +124,7 @@ class ActGroup:
                     0, # shuffle_color
                     0, # hide_action
                     self.trinary,
-                    self.replay_buffer,
+                    self.replay_buffers[partner_idx],
                     1, # multi-step
                     self.max_len,
                     self.gamma,
@@ -121,12 +138,12 @@ class ActGroup:
                 self.seed += 1
 
                 actor = hanalearn.R2D2Actor(
-                    self.model_runners[i % self.num_runners][1], # runner
+                    runners[1 + partner_idx], # runner
                     self.num_player, # numPlayer
                     1, # playerIdx
                     False, # vdn
-                    self._partner_sad, # sad
-                    self._partner_hide_action, # hideAction
+                    partner_sad, # sad
+                    partner_hide_action, # hideAction
                     self.convention, # convention
                     0, # conventionSender
                     1) # conventionOverride
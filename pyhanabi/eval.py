@@ -26,6 +26,7 @@ def evaluate(
     hide_action,
     *,
     num_thread=10,
+    act_batchsize=1000,
     max_len=80,
     device="cuda:0",
     convention=[],
@@ -46,7 +47,7 @@ def evaluate(
 
     # Create Batch Runners only if agent is a learned r2d2 agent.
     runners = [
-        rela.BatchRunner(agent, device, 1000, ["act"]) 
+        rela.BatchRunner(agent, device, act_batchsize, ["act"])
         if isinstance(agent, r2d2.R2D2Agent)
         else None
         for agent in agents
@@ -130,6 +131,7 @@ def evaluate_saved_model(
     convention="None",
     convention_sender=0,
     override=[0, 0],
+    tune_config="None",
 ):
     agents = []
     sad = []
@@ -159,6 +161,14 @@ def evaluate_saved_model(
         hide_action.append(bool(cfg["hide_action"]))
         agent.train(False)
 
+    # thread/batch sizes found by rlcc/tools/autotune.cc
+    tune = utils.load_tune_config(tune_config)
+    tune_args = {}
+    if "num_thread" in tune and num_game % tune["num_thread"] == 0:
+        tune_args["num_thread"] = tune["num_thread"]
+    if "act_batchsize" in tune:
+        tune_args["act_batchsize"] = tune["act_batchsize"]
+
     scores = []
     perfect = 0
     for i in range(num_run):
@@ -173,6 +183,7 @@ def evaluate_saved_model(
             convention=load_convention(convention),
             convention_sender=convention_sender,
             override=override,
+            **tune_args,
         )
         scores.extend(score)
         perfect += p
@@ -71,6 +71,7 @@ def run_evaluation(args, weight_files):
         convention=args.convention,
         convention_sender=args.convention_sender,
         override=[args.override0, args.override1],
+        tune_config=args.tune_config,
     )
 
     return scores, actors
@@ -182,6 +183,7 @@ if __name__ == "__main__":
     )
     parser.add_argument("--convention", default="None", type=str)
     parser.add_argument("--convention_sender", default=0, type=int)
+    parser.add_argument("--tune_config", default="None", type=str)
     parser.add_argument('--override0', action='store_true')
     parser.add_argument('--override1', action='store_true')
     parser.set_defaults(override0=False, override1=False)
@@ -0,0 +1,239 @@
+# Runs the c++ benchmarks (build/microbench & build/selfplay_bench) a few
+# times, compares the median of every metric against perf_baseline.json and
+# prints a pass/fail line per metric. Exits with 1 if any metric regressed.
+#
+# A metric fails if it is worse than the baseline by more than
+# max(--tolerance, --noise_factor * noise), where noise is the relative
+# spread of the repeated runs, of the baseline or of this run, whichever is
+# larger. Allocation counts are deterministic and use --alloc_tolerance.
+# A baseline metric that this run did not produce (e.g. a renamed or
+# crashed benchmark) is MISSING and fails too, unless --allow_missing.
+#
+# usage:
+#   python tools/perf_regression.py --build_dir ../build
+#   python tools/perf_regression.py --build_dir ../build --update  # new baseline
+#
+# Recording the baseline: none is shipped with the repo and the check
+# refuses to run until one is recorded. Baselines are only comparable on
+# the same kind of machine, so on the actor machine:
+#   1. build microbench & selfplay_bench at the commit to compare against
+#   2. python tools/perf_regression.py --build_dir ../build --update
+#   3. keep tools/perf_baseline.json, it records the machine it ran on
+# Re-record after an intended performance change, or when benchmarks are
+# added, renamed or removed.
+import argparse
+import json
+import os
+import platform
+import socket
+import statistics
+import subprocess
+import sys
+import tempfile
+
+
+# metric name -> whether lower values are better
+MICRO_METRICS = {"ns_per_op": True, "alloc_per_op": True}
+SELFPLAY_METRICS = {
+    "env_step_per_sec": False,
+    "episode_per_sec": False,
+    "act_batch_fill": False,
+    "replay_add_per_sec": False,
+}
+
+
+def machine_info():
+    cpu = platform.processor()
+    if os.path.exists("/proc/cpuinfo"):
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    cpu = line.split(":", 1)[1].strip()
+                    break
+    return {"host": socket.gethostname(), "cpu": cpu, "num_cpu": os.cpu_count()}
+
+
+def run_json(cmd):
+    with tempfile.TemporaryDirectory() as tmp:
+        out = os.path.join(tmp, "out.json")
+        print("running:", " ".join(cmd + ["--out", out]))
+        subprocess.run(cmd + ["--out", out], check=True, stdout=subprocess.DEVNULL)
+        with open(out) as f:
+            return json.load(f)
+
+
+def collect_micro(args):
+    cmd = [os.path.join(args.build_dir, "microbench"), "--seconds", str(args.seconds)]
+    if args.filter:
+        cmd += ["--filter", args.filter]
+    samples = {}
+    for _ in range(args.repeat):
+        for bench in run_json(cmd)["benchmarks"]:
+            for metric, lower in MICRO_METRICS.items():
+                key = "micro/%s/%s" % (bench["name"], metric)
+                samples.setdefault(key, ([], lower))[0].append(bench[metric])
+    return samples
+
+
+def collect_selfplay(args):
+    cmd = [
+        os.path.join(args.build_dir, "selfplay_bench"),
+        "--seconds",
+        str(args.selfplay_seconds),
+        "--num_thread",
+        args.selfplay_threads,
+    ]
+    samples = {}
+    for _ in range(args.repeat):
+        for run in run_json(cmd)["runs"]:
+            for metric, lower in SELFPLAY_METRICS.items():
+                key = "selfplay/t%d/%s" % (run["num_thread"], metric)
+                samples.setdefault(key, ([], lower))[0].append(run[metric])
+    return samples
+
+
+def summarize(samples):
+    metrics = {}
+    for key, (values, lower) in samples.items():
+        median = statistics.median(values)
+        noise = 0.0
+        if median != 0:
+            noise = (max(values) - min(values)) / 2 / abs(median)
+        metrics[key] = {"value": median, "noise": noise, "lower_is_better": lower}
+    return metrics
+
+
+def compare(baseline, current, args):
+    rows = []
+    for key in sorted(set(baseline) | set(current)):
+        if key not in current:
+            rows.append((key, baseline[key]["value"], None, None, None, "MISSING"))
+            continue
+        if key not in baseline:
+            rows.append((key, None, current[key]["value"], None, None, "NEW"))
+            continue
+        base = baseline[key]
+        cur = current[key]
+        if base["value"] == 0:
+            change = 0.0 if cur["value"] == 0 else float("inf")
+        else:
+            change = (cur["value"] - base["value"]) / abs(base["value"])
+        # positive = worse
+        worse = change if cur["lower_is_better"] else -change
+        if key.endswith("alloc_per_op"):
+            # half an allocation per op of slack for the multi-threaded ones
+            allowed = max(args.alloc_tolerance * base["value"], 0.5)
+            threshold = allowed / max(base["value"], 1e-9)
+            regressed = cur["value"] - base["value"] > allowed
+        else:
+            noise = max(base["noise"], cur["noise"])
+            threshold = max(args.tolerance, args.noise_factor * noise)
+            regressed = worse > threshold
+        status = "FAIL" if regressed else "PASS"
+        rows.append((key, base["value"], cur["value"], change, threshold, status))
+    return rows
+
+
+def print_report(rows):
+    width = max([len(r[0]) for r in rows] + [6])
+    header = ("metric", "baseline", "current", "change", "thresh", "status")
+    print("%-*s %14s %14s %9s %9s  %s" % ((width,) + header))
+    fmt_val = lambda v: "-" if v is None else "%.4g" % v
+    fmt_pct = lambda v: "-" if v is None else "%+.1f%%" % (100 * v)
+    for key, base, cur, change, threshold, status in rows:
+        print(
+            "%-*s %14s %14s %9s %9s  %s"
+            % (width, key, fmt_val(base), fmt_val(cur), fmt_pct(change), fmt_pct(threshold), status)
+        )
+
+
+def main(args):
+    samples = {}
+    suites = args.suite.split(",")
+    if "micro" in suites:
+        samples.update(collect_micro(args))
+    if "selfplay" in suites:
+        samples.update(collect_selfplay(args))
+    current = summarize(samples)
+
+    if args.update:
+        baseline = {"machine": machine_info(), "metrics": current}
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("baseline with %d metrics written to %s" % (len(current), args.baseline))
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print(
+            "Error: no baseline at %s, record one on this machine with --update"
+            % args.baseline
+        )
+        return 1
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    if not baseline["metrics"]:
+        print("Error: %s has no metrics yet, record it with --update" % args.baseline)
+        return 1
+    machine = machine_info()
+    same = lambda m: m["cpu"] == machine["cpu"] and m["num_cpu"] == machine["num_cpu"]
+    if baseline["machine"] and not same(baseline["machine"]):
+        print("Warning: baseline was recorded on", baseline["machine"])
+        print("         this machine is", machine)
+
+    # only the benchmarks that were run
+    expected = {
+        k: v
+        for k, v in baseline["metrics"].items()
+        if k.split("/")[0] in suites and (k.startswith("selfplay/") or args.filter in k)
+    }
+    rows = compare(expected, current, args)
+    print_report(rows)
+    failed = ["FAIL"] if args.allow_missing else ["FAIL", "MISSING"]
+    num_fail = sum(1 for r in rows if r[-1] in failed)
+    if args.report:
+        with open(args.report, "w") as f:
+            json.dump(
+                [
+                    dict(zip(["metric", "baseline", "current", "change", "threshold", "status"], r))
+                    for r in rows
+                ],
+                f,
+                indent=2,
+            )
+    print("%d metrics, %d failed" % (len(rows), num_fail))
+    return 1 if num_fail > 0 else 0
+
+
+def parse_args():
+    root = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+    parser = argparse.ArgumentParser(description="perf regression check")
+    parser.add_argument("--build_dir", type=str, default=os.path.join(root, "build"))
+    parser.add_argument(
+        "--baseline",
+        type=str,
+        default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "perf_baseline.json"),
+    )
+    parser.add_argument("--update", action="store_true", help="overwrite the baseline")
+    parser.add_argument("--report", type=str, default="", help="also save the report as json")
+    parser.add_argument("--suite", type=str, default="micro,selfplay")
+    parser.add_argument("--filter", type=str, default="", help="microbench --filter")
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--seconds", type=float, default=1, help="per microbenchmark")
+    parser.add_argument("--selfplay_seconds", type=float, default=10)
+    parser.add_argument("--selfplay_threads", type=str, default="1,4")
+    parser.add_argument("--tolerance", type=float, default=0.1, help="relative")
+    parser.add_argument("--noise_factor", type=float, default=2)
+    parser.add_argument(
+        "--alloc_tolerance", type=float, default=0.02, help="relative, at least 0.5 alloc/op"
+    )
+    parser.add_argument(
+        "--allow_missing",
+        action="store_true",
+        help="pass baseline metrics that this run did not produce",
+    )
+    return parser.parse_args()
+
+
+if __name__ == "__main__":
+    sys.exit(main(parse_args()))
@@ -12,9 +12,15 @@ from create import create_envs, create_threads
 from eval import evaluate
 import common_utils
 import rela
+import hanalearn
 import r2d2
 import utils
 
+# fields of a sampled batch that td_error and train_loop read, always
+# sampled when --sample_keys restricts the batch
+LEARNER_KEYS = ["priv_s", "publ_s", "legal_move", "temperature", "a", "h0", "c0"]
+
+
 class Trainer:
     def __init__(self, args):
         self._args = args
@@ -29,6 +35,9 @@ class Trainer:
 
         common_utils.set_all_seeds(args.seed)
         pprint.pprint(vars(args))
+        if args.small_tensor_pool:
+            hanalearn.enable_small_tensor_pool()
+            self._num_pooled = 0
 
         self._explore_eps = utils.generate_explore_eps(
             args.act_base_eps, args.act_eps_alpha, args.num_t
@@ -90,29 +99,38 @@ class Trainer:
             {"vdn": False, "boltzmann_act": False}
         )
 
-        self._replay_buffer = rela.RNNPrioritizedReplay(
-            args.replay_buffer_size,
-            args.seed,
-            args.priority_exponent,
-            args.priority_weight,
-            args.prefetch,
-        )
+        # one buffer per partner when training against several of them
+        partners = args.partner.split(",")
+        if len(partners) > 1:
+            actor_replay = self.create_composite_replay(args, len(partners))
+        else:
+            self.create_replay_buffer(args)
+            actor_replay = self._replay_buffer
+        self._sample_keys = [k for k in args.sample_keys.split(",") if k]
+        if self._sample_keys:
+            missing = [k for k in LEARNER_KEYS if k not in self._sample_keys]
+            if missing:
+                print("sample_keys: adding", missing, "read by the learner")
+                self._sample_keys += missing
 
         self._act_group = ActGroup(
             args.act_device,
             self._agent,
-            args.partner,
+            partners,
             args.seed,
             args.num_thread,
             args.num_game_per_thread,
             args.num_player,
             self._explore_eps,
             True,  # trinary, 3 bits for aux task
-            self._replay_buffer,
+            actor_replay,
             args.max_len,
             args.gamma,
             self._convention,
-            args.convention_act_override
+            args.convention_act_override,
+            act_batchsize=args.act_batchsize,
+            priority_batchsize=args.priority_batchsize,
+            target_batchsize=args.target_batchsize,
         )
 
         self._context, self._threads = create_threads(
@@ -122,6 +140,65 @@ class Trainer:
             self._games,
         )
 
+    def create_replay_buffer(self, args):
+        self._replay_buffer = rela.RNNPrioritizedReplay(
+            args.replay_buffer_size,
+            args.seed,
+            args.priority_exponent,
+            args.priority_weight,
+            args.prefetch,
+            getattr(rela.EvictionPolicy, args.replay_eviction.upper()),
+        )
+        if args.samples_per_insert > 0:
+            tolerance = args.rate_limit_tolerance
+            if tolerance < 0:
+                tolerance = 2 * args.batchsize
+            self._replay_buffer.set_rate_limit(
+                args.samples_per_insert, args.burn_in_frames, tolerance
+            )
+        if args.prefetch > 0:
+            self._replay_buffer.configure_sampler(
+                args.sampler_worker,
+                args.prefetch,
+                [int(x) for x in args.sampler_cpus.split(",") if x],
+            )
+        if args.replay_disk_path:
+            self._replay_buffer.enable_disk_tier(
+                args.replay_disk_path,
+                args.replay_hot_size,
+                int(args.replay_slot_mb * 1024 * 1024),
+            )
+        if args.replay_snapshot and os.path.exists(args.replay_snapshot):
+            t = time.time()
+            self._replay_buffer.load(args.replay_snapshot)
+            print(
+                "loaded %d episodes from %s in %.1fs"
+                % (self._replay_buffer.size(), args.replay_snapshot, time.time() - t)
+            )
+        if args.length_buckets:
+            self._replay_buffer.set_length_buckets(
+                [int(x) for x in args.length_buckets.split(",")]
+            )
+
+    def create_composite_replay(self, args, num_partner):
+        """returns the buffers for the actors, partner i's games go to the i-th"""
+        self._replay_buffer = rela.RNNCompositeReplay(
+            args.seed, args.priority_exponent, args.priority_weight
+        )
+        eviction = getattr(rela.EvictionPolicy, args.replay_eviction.upper())
+        names = ["partner%d" % i for i in range(num_partner)]
+        buffers = [
+            self._replay_buffer.add_buffer(
+                name, args.replay_buffer_size // num_partner, eviction
+            )
+            for name in names
+        ]
+        mix = [1.0] * num_partner
+        if args.partner_mix:
+            mix = [float(x) for x in args.partner_mix.split(",")]
+        self._replay_buffer.set_mix(dict(zip(names, mix)))
+        return buffers
+
     def warm_up_replay_buffer(self):
         self._act_group.start()
         self._context.start()
@@ -143,19 +220,33 @@ class Trainer:
             tachometer.start()
             stat.reset()
             stopwatch.reset()
+            if self._args.trace_path and epoch == self._args.trace_epoch:
+                rela.trace_start()
+                hanalearn.trace_start()
 
             for batch_idx in range(self._args.epoch_len):
                 num_update = batch_idx + epoch * self._args.epoch_len
                 if num_update % self._args.num_update_between_sync == 0:
                     self._agent.sync_target_with_online()
                 if num_update % self._args.actor_sync_freq == 0:
+                    rate_limited = self._args.samples_per_insert > 0
+                    if self._args.pause_on_sync:
+                        # actors blocked by the rate limiter could never park
+                        if rate_limited:
+                            self._replay_buffer.suspend_insert_limit(True)
+                        self._context.pause()
+                        stat["pause_latency"].feed(self._context.last_pause_latency())
                     self._act_group.update_model(self._agent)
+                    if self._args.pause_on_sync:
+                        self._context.resume()
+                        if rate_limited:
+                            self._replay_buffer.suspend_insert_limit(False)
 
                 torch.cuda.synchronize()
                 stopwatch.time("sync and updating")
 
                 batch, weight = self._replay_buffer.sample(
-                        self._args.batchsize, self._args.train_device)
+                        self._args.batchsize, self._args.train_device, self._sample_keys)
                 stopwatch.time("sample data")
 
                 loss, priority, online_q = self._agent.loss(
@@ -181,12 +272,43 @@ class Trainer:
                 stat["loss"].feed(loss.detach().item())
                 stat["grad_norm"].feed(g_norm)
                 stat["boltzmann_t"].feed(batch.obs["temperature"][0].mean())
+                stat["batch_seq_len"].feed(batch.max_seq_len)
+
+            if self._args.trace_path and epoch == self._args.trace_epoch:
+                rela.trace_stop()
+                hanalearn.trace_stop()
+                save_trace(self._args.trace_path)
 
             count_factor = 1
             print("epoch: %d" % epoch)
             tachometer.lap(self._replay_buffer, self._args.epoch_len * self._args.batchsize, count_factor)
             stopwatch.summary()
             stat.summary(epoch)
+            if isinstance(self._replay_buffer, rela.RNNCompositeReplay):
+                for name, stats in sorted(self._replay_buffer.stats().items()):
+                    print("replay %s:" % name, stats)
+            elif self._args.prefetch > 0:
+                print("sampler:", self._replay_buffer.sampler_stats())
+            if self._args.samples_per_insert > 0:
+                print("rate limit:", self._replay_buffer.rate_limit_stats())
+            if self._args.replay_disk_path:
+                print("disk tier:", self._replay_buffer.disk_tier_stats())
+            if self._args.small_tensor_pool:
+                pool_stats = hanalearn.small_tensor_pool_stats()
+                print("small tensor pool:", pool_stats)
+                # the actors allocate every step, a flat count means that
+                # the pool is not installed where the actor threads run
+                if pool_stats["num_pooled"] <= self._num_pooled:
+                    print("Warning: small tensor pool: no pooled allocation in epoch %d" % epoch)
+                self._num_pooled = pool_stats["num_pooled"]
+            if self._args.batcher_stats:
+                # runners[0] serves the trained agent, the rest the partners
+                for dev, runners in zip(self._act_group.devices, self._act_group.model_runners):
+                    for i, runner in enumerate(runners):
+                        name = "agent" if i == 0 else "partner%d" % (i - 1)
+                        for method, stats in runner.stats().items():
+                            print("batcher %s %s %s:" % (dev, name, method), stats)
+                        runner.reset_stats()
 
             eval_seed = (9917 + epoch * 999999) % 7777777
             self._eval_agent.load_state_dict(self._agent.state_dict())
@@ -214,8 +336,46 @@ class Trainer:
                 % (epoch, score, perfect * 100, model_saved)
             )
 
+            if (
+                self._args.replay_snapshot
+                and (epoch + 1) % self._args.replay_snapshot_freq == 0
+            ):
+                # written in background, the previous save is waited for
+                self._replay_buffer.save(self._args.replay_snapshot)
+
             print("==========")
 
+        if self._args.replay_snapshot:
+            self._replay_buffer.wait_save()
+
+
+def save_trace(path):
+    # rela (runners, sampler) and hanalearn (actor threads) each record their
+    # own threads, merge them as two processes of one trace
+    events = []
+    for pid, module in enumerate([rela, hanalearn]):
+        part = "%s.%s" % (path, module.__name__)
+        module.trace_dump(part, pid)
+        with open(part) as f:
+            events += json.load(f)["traceEvents"]
+        os.remove(part)
+        events.append(
+            {"name": "process_name", "ph": "M", "pid": pid, "args": {"name": module.__name__}}
+        )
+    with open(path, "w") as f:
+        json.dump({"traceEvents": events}, f)
+
+    actor_threads = {
+        (e["pid"], e["tid"])
+        for e in events
+        if e["name"] == "thread_name" and e["args"]["name"] == "actor_loop"
+    }
+    num_actor_event = sum(
+        1 for e in events if e["ph"] == "X" and (e["pid"], e["tid"]) in actor_threads
+    )
+    print("trace saved to %s, %d actor_loop events" % (path, num_actor_event))
+    if num_actor_event == 0:
+        print("Warning: no actor_loop events in the trace")
 
 
 def parse_args():
@@ -264,23 +424,147 @@ def parse_args():
     )
     parser.add_argument("--max_len", type=int, default=80, help="max seq len")
     parser.add_argument("--prefetch", type=int, default=3, help="#prefetch batch")
+    parser.add_argument(
+        "--samples_per_insert",
+        type=float,
+        default=0,
+        help="target #sampled / #inserted episodes, 0 to disable the rate limit",
+    )
+    parser.add_argument(
+        "--rate_limit_tolerance",
+        type=float,
+        default=-1,
+        help="allowed drift in #sampled episodes, default 2 * batchsize",
+    )
+    parser.add_argument(
+        "--replay_snapshot",
+        type=str,
+        default="",
+        help="replay is loaded from here if it exists and saved periodically",
+    )
+    parser.add_argument("--replay_snapshot_freq", type=int, default=10, help="#epoch")
+    parser.add_argument(
+        "--sample_keys",
+        type=str,
+        default="",
+        help="comma separated obs/action/h0 keys to sample on top of the ones "
+        "the learner reads, empty for all",
+    )
+    parser.add_argument(
+        "--replay_eviction",
+        type=str,
+        default="fifo",
+        choices=["fifo", "lowest_priority", "reservoir"],
+    )
+    parser.add_argument(
+        "--replay_disk_path",
+        type=str,
+        default="",
+        help="keep only replay_hot_size transitions in RAM, spill the rest to this file",
+    )
+    parser.add_argument("--replay_hot_size", type=int, default=2 ** 17)
+    parser.add_argument("--replay_slot_mb", type=float, default=1.0, help="disk slot per transition")
+    parser.add_argument("--sampler_worker", type=int, default=1)
+    parser.add_argument(
+        "--trace_path",
+        type=str,
+        default="",
+        help="save a chrome trace of trace_epoch here, needs rela built with RELA_TRACE=ON",
+    )
+    parser.add_argument("--trace_epoch", type=int, default=1)
+    parser.add_argument(
+        "--batcher_stats",
+        type=int,
+        default=0,
+        help="print batch size & wait time histograms of the runners every epoch",
+    )
+    parser.add_argument(
+        "--small_tensor_pool",
+        type=int,
+        default=0,
+        help="serve small cpu tensors of actor threads from per thread pools",
+    )
+    parser.add_argument(
+        "--sampler_cpus", type=str, default="", help="e.g. 0,1: pin sampler threads"
+    )
+    parser.add_argument(
+        "--length_buckets",
+        type=str,
+        default="",
+        help="e.g. 30,50: sample each batch from one seq len bucket",
+    )
 
     # thread setting
     parser.add_argument("--num_thread", type=int, default=10, help="#thread_loop")
     parser.add_argument("--num_game_per_thread", type=int, default=40)
+    parser.add_argument("--act_batchsize", type=int, default=5000)
+    parser.add_argument("--priority_batchsize", type=int, default=100)
+    parser.add_argument("--target_batchsize", type=int, default=5000)
+    parser.add_argument(
+        "--tune_config",
+        type=str,
+        default="None",
+        help="json from rlcc/tools/autotune.cc, sets thread & batch sizes not given explicitly",
+    )
 
     # actor setting
     parser.add_argument("--act_base_eps", type=float, default=0.1)
     parser.add_argument("--act_eps_alpha", type=float, default=7)
     parser.add_argument("--act_device", type=str, default="cuda:1")
     parser.add_argument("--actor_sync_freq", type=int, default=10)
+    parser.add_argument(
+        "--pause_on_sync",
+        type=int,
+        default=0,
+        help="park all thread loops while syncing actor models",
+    )
 
     # convention setting
     parser.add_argument("--convention", type=str, default="None")
     parser.add_argument("--convention_act_override", type=int, default=0)
-    parser.add_argument("--partner", type=str, default="None")
+    parser.add_argument(
+        "--partner",
+        type=str,
+        default="None",
+        help="weight file, comma separated for several partners",
+    )
+    parser.add_argument(
+        "--partner_mix",
+        type=str,
+        default="",
+        help="e.g. 3,1: share of each partner's replay in a batch, equal by default",
+    )
 
     args = parser.parse_args()
+    num_partner = len(args.partner.split(","))
+    if args.partner_mix and len(args.partner_mix.split(",")) != num_partner:
+        parser.error("--partner_mix needs one ratio per partner")
+    if num_partner > 1:
+        # sampled directly from the per partner buffers, without a sampler
+        for flag in ["samples_per_insert", "replay_snapshot", "replay_disk_path", "length_buckets"]:
+            if getattr(args, flag):
+                parser.error("--%s is not supported with several partners" % flag)
+
+    # flags given explicitly on the command line win over the tune config
+    tune = utils.load_tune_config(args.tune_config)
+    explicit = {a.split("=")[0][2:] for a in sys.argv[1:] if a.startswith("--")}
+    for key in [
+        "num_thread",
+        "num_game_per_thread",
+        "act_batchsize",
+        "priority_batchsize",
+        "target_batchsize",
+    ]:
+        if key not in tune:
+            continue
+        if key in explicit:
+            print(
+                "tune_config: keeping --%s=%s, ignoring %s"
+                % (key, getattr(args, key), tune[key])
+            )
+            continue
+        print("tune_config: %s %s -> %s" % (key, getattr(args, key), tune[key]))
+        setattr(args, key, tune[key])
     return args
 
 
@@ -318,6 +318,14 @@ def get_num_acts(actors):
     return total_acts
 
 
+def load_tune_config(tune_config_path):
+    """load the json written by rlcc/tools/autotune.cc, {} if path is None"""
+    if tune_config_path == "None":
+        return {}
+    with open(tune_config_path) as f:
+        return json.load(f)
+
+
 def generate_explore_eps(base_eps, alpha, num_env):
     if num_env == 1:
         if base_eps < 1e-6:
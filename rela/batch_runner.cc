@@ -5,10 +5,19 @@
 // LICENSE file in the root directory of this source tree.
 //
 #include "batch_runner.h"
+#include "rela/packed_tensors.h"
 
 namespace rela {
 
 FutureReply BatchRunner::call(const std::string& method, const TensorDict& t) const {
+  return batcher(method).send(t);
+}
+
+FutureReply BatchRunner::call(const std::string& method, const TensorRecord& t) const {
+  return batcher(method).send(t);
+}
+
+Batcher& BatchRunner::batcher(const std::string& method) const {
   auto batcherIt = batchers_.find(method);
   if (batcherIt == batchers_.end()) {
     std::cerr << "Error: Cannot find method: " << method << std::endl;
@@ -18,12 +27,36 @@ FutureReply BatchRunner::call(const std::string& method, const TensorDict& t) co
     }
     assert(false);
   }
-  return batcherIt->second->send(t);
+  return *batcherIt->second;
+}
+
+std::tuple<int64_t, int64_t> BatchRunner::batchCount(const std::string& method) const {
+  auto batcherIt = batchers_.find(method);
+  if (batcherIt == batchers_.end()) {
+    return {0, 0};
+  }
+  return {batcherIt->second->numBatch(), batcherIt->second->numData()};
+}
+
+std::unordered_map<std::string, std::unordered_map<std::string, float>> BatchRunner::stats()
+    const {
+  std::unordered_map<std::string, std::unordered_map<std::string, float>> stats;
+  for (auto& kv : batchers_) {
+    stats[kv.first] = kv.second->stats();
+  }
+  return stats;
+}
+
+void BatchRunner::resetStats() {
+  for (auto& kv : batchers_) {
+    kv.second->resetStats();
+  }
 }
 
 void BatchRunner::start() {
   for (size_t i = 0; i < methods_.size(); ++i) {
-    batchers_.emplace(methods_[i], std::make_unique<Batcher>(batchsizes_[i]));
+    batchers_.emplace(
+        methods_[i], std::make_unique<Batcher>(batchsizes_[i], !device_.is_cpu()));
   }
 
   for (auto& kv : batchers_) {
@@ -64,19 +97,22 @@ void BatchRunner::runnerLoop(const std::string& method) {
     assert(false);
   }
   auto& batcher = *(batcherIt->second);
+  RELA_TRACE_THREAD("runner_" + method);
 
   int aggSize = 0;
   int aggCount = 0;
+  // interned once, replies of a method always have the same fields
+  SchemaPtr replySchema;
 
   while (!batcher.terminated()) {
-    auto batch = batcher.get();
-    if (batch.empty()) {
+    auto packed = batcher.getPacked();
+    if (packed.empty()) {
       assert(batcher.terminated());
       break;
     }
 
     if (logFreq_ > 0) {
-      aggSize += (batch.begin()->second.size(0));
+      aggSize += packed.sizes(0)[0];
       aggCount += 1;
 
       if (aggCount % logFreq_ == 0) {
@@ -89,16 +125,25 @@ void BatchRunner::runnerLoop(const std::string& method) {
 
     {
       std::lock_guard<std::mutex> lk(mtxDevice_);
+      RELA_TRACE_SCOPE("runner_forward");
 
       torch::NoGradGuard ng;
       std::vector<torch::jit::IValue> input;
-      input.push_back(tensor_dict::toIValue(batch, device_));
+      // one host to device copy for the whole batch
+      TensorRecord batch(batcher.schema(), packed.to(device_).unpack());
+      input.push_back(tensor_record::toIValue(batch, device_));
       torch::jit::IValue output;
       {
-        std::lock_guard<std::mutex> lk(mtxUpdate_);
+        std::unique_lock<std::mutex> lk(mtxUpdate_, std::defer_lock);
+        {
+          ScopedHistogramTimer timer(batcher.updateStallHist());
+          lk.lock();
+        }
+        ScopedHistogramTimer timer(batcher.forwardHist());
         output = jitModel_->get_method(method)(input);
       }
-      batcher.set(tensor_dict::fromIValue(output, torch::kCPU, true));
+      auto reply = tensor_record::fromIValue(output, true, &replySchema);
+      batcher.set(tensor_record::toHost(reply, &batcher.replyStaging(), batcher.pinned()));
     }
   }
 }
@@ -34,6 +34,15 @@ class BatchRunner {
       , device_(torch::Device(device)) {
   }
 
+  // for standalone c++ programs, e.g. a model loaded with torch::jit::load,
+  // updateModel is not supported since there is no python agent behind it
+  BatchRunner(
+      std::shared_ptr<torch::jit::script::Module> jitModule, const std::string& device)
+      : jitModule_(std::move(jitModule))
+      , jitModel_(jitModule_.get())
+      , device_(torch::Device(device)) {
+  }
+
   BatchRunner(const BatchRunner&) = delete;
   BatchRunner& operator=(const BatchRunner&) = delete;
 
@@ -52,11 +61,14 @@ class BatchRunner {
 
   FutureReply call(const std::string& method, const TensorDict& t) const;
 
+  FutureReply call(const std::string& method, const TensorRecord& t) const;
+
   void start();
 
   void stop();
 
   void updateModel(py::object agent) {
+    assert(jitModule_ == nullptr);
     std::lock_guard<std::mutex> lk(mtxUpdate_);
     pyModel_.attr("load_state_dict")(agent.attr("state_dict")());
   }
@@ -65,13 +77,25 @@ class BatchRunner {
     return *jitModel_;
   }
 
+  // (numBatch, numData) served for method since start, mean batchsize is
+  // numData / numBatch
+  std::tuple<int64_t, int64_t> batchCount(const std::string& method) const;
+
+  // Batcher::stats() of every method
+  std::unordered_map<std::string, std::unordered_map<std::string, float>> stats() const;
+
+  void resetStats();
+
   // for debugging
   rela::TensorDict blockCall(const std::string& method, const TensorDict& t);
 
  private:
   void runnerLoop(const std::string& method);
 
+  Batcher& batcher(const std::string& method) const;
+
   py::object pyModel_;
+  std::shared_ptr<torch::jit::script::Module> jitModule_;
   torch::jit::script::Module* const jitModel_;
   const torch::Device device_;
   std::vector<int> batchsizes_;
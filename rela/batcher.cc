@@ -11,24 +11,25 @@ namespace rela {
 
 class FutureReply_ {
  public:
-  FutureReply_()
-      : ready_(false) {
+  FutureReply_(std::shared_ptr<Histogram> waitHist)
+      : waitHist_(std::move(waitHist))
+      , ready_(false) {
   }
 
-  TensorDict get(int slot) {
-    std::unique_lock<std::mutex> lk(mReady_);
-    cvReady_.wait(lk, [this] { return ready_; });
-    lk.unlock();
+  TensorRecord get(int slot) {
+    {
+      ScopedHistogramTimer timer(*waitHist_);
+      std::unique_lock<std::mutex> lk(mReady_);
+      cvReady_.wait(lk, [this] { return ready_; });
+    }
 
-    TensorDict e;
-    for (const auto& kv : data_) {
-      assert(slot >= 0 && slot < kv.second.size(0));
-      e[kv.first] = kv.second[slot];
+    for (int i = 0; i < data_.size(); ++i) {
+      assert(slot >= 0 && slot < data_[i].size(0));
     }
-    return e;
+    return tensor_record::index(data_, slot);
   }
 
-  void set(TensorDict&& t) {
+  void set(TensorRecord&& t) {
     {
       std::lock_guard<std::mutex> lk(mReady_);
       ready_ = true;
@@ -39,7 +40,8 @@ class FutureReply_ {
 
  private:
   // no need for protection, only set() can set it
-  TensorDict data_;
+  TensorRecord data_;
+  std::shared_ptr<Histogram> waitHist_;
 
   std::mutex mReady_;
   bool ready_;
@@ -47,40 +49,100 @@ class FutureReply_ {
 };
 
 TensorDict FutureReply::get() {
+  return getRecord().toDict();
+}
+
+TensorRecord FutureReply::getRecord() {
   assert(fut_ != nullptr);
   auto ret = fut_->get(slot);
   fut_ = nullptr;
   return ret;
 }
 
-Batcher::Batcher(int batchsize)
+Batcher::Batcher(int batchsize, bool pinned)
     : batchsize_(batchsize)
+    , pinned_(pinned)
+    , actorWaitHist_(std::make_shared<Histogram>())
     , nextSlot_(0)
     , numActiveWrite_(0)
-    , fillingReply_(std::make_shared<FutureReply_>())
+    , fillingReply_(std::make_shared<FutureReply_>(actorWaitHist_))
     , filledReply_(nullptr) {
   assert(batchsize_ > 0);
 }
 
 // send data into batcher
 FutureReply Batcher::send(const TensorDict& t) {
+  RELA_TRACE_SCOPE("batcher_send");
   std::unique_lock<std::mutex> lk(mNextSlot_);
 
   // init buffer
-  if (fillingBuffer_.empty()) {
-    assert(filledBuffer_.empty());
-    fillingBuffer_ = allocateBatchStorage(t, batchsize_);
-    filledBuffer_ = allocateBatchStorage(t, batchsize_);
+  if (schema_ == nullptr) {
+    auto record = TensorRecord::fromDict(t);
+    schema_ = record.schema();
+    fillingBuffer_ = tensor_record::allocateBatchStorage(record, batchsize_);
+    filledBuffer_ = tensor_record::allocateBatchStorage(record, batchsize_);
   } else {
-    if (t.size() != fillingBuffer_.size()) {
+    if ((int)t.size() != schema_->size()) {
       std::cout << "key in buffer: " << std::endl;
-      utils::printMapKey(fillingBuffer_);
+      utils::printVector(schema_->keys());
       std::cout << "key in data: " << std::endl;
       utils::printMapKey(t);
       assert(false);
     }
   }
 
+  int slot = reserveSlot(lk);
+
+  // this will copy
+  for (const auto& kv : t) {
+    int i = schema_->indexOf(kv.first);
+    assert(i >= 0);
+    auto dst = fillingBuffer_[i][slot];
+    if (dst.sizes() != kv.second.sizes()) {
+      std::cout << "cannot batch data, batcher need size: " << dst.sizes()
+                << ", get: " << kv.second.sizes() << std::endl;
+    }
+    dst.copy_(kv.second);
+  }
+
+  return finishSlot(slot);
+}
+
+FutureReply Batcher::send(const TensorRecord& t) {
+  RELA_TRACE_SCOPE("batcher_send");
+  std::unique_lock<std::mutex> lk(mNextSlot_);
+
+  // init buffer
+  if (schema_ == nullptr) {
+    schema_ = t.schema();
+    fillingBuffer_ = tensor_record::allocateBatchStorage(t, batchsize_);
+    filledBuffer_ = tensor_record::allocateBatchStorage(t, batchsize_);
+  } else {
+    if (t.schema() != schema_) {
+      std::cout << "key in buffer: " << std::endl;
+      utils::printVector(schema_->keys());
+      std::cout << "key in data: " << std::endl;
+      utils::printVector(t.schema()->keys());
+      assert(false);
+    }
+  }
+
+  int slot = reserveSlot(lk);
+
+  // this will copy
+  for (int i = 0; i < t.size(); ++i) {
+    auto dst = fillingBuffer_[i][slot];
+    if (dst.sizes() != t[i].sizes()) {
+      std::cout << "cannot batch data, batcher need size: " << dst.sizes()
+                << ", get: " << t[i].sizes() << std::endl;
+    }
+    dst.copy_(t[i]);
+  }
+
+  return finishSlot(slot);
+}
+
+int Batcher::reserveSlot(std::unique_lock<std::mutex>& lk) {
   assert(nextSlot_ <= batchsize_);
   // wait if current batch is full and not extracted
   cvNextSlot_.wait(lk, [this] { return nextSlot_ < batchsize_; });
@@ -89,22 +151,15 @@ FutureReply Batcher::send(const TensorDict& t) {
   ++nextSlot_;
   ++numActiveWrite_;
   lk.unlock();
+  return slot;
+}
 
-  // this will copy
-  for (const auto& kv : t) {
-    if (fillingBuffer_[kv.first][slot].sizes() != kv.second.sizes()) {
-      std::cout << "cannot batch data, batcher need size: "
-                << fillingBuffer_[kv.first][slot].sizes()
-                << ", get: " << kv.second.sizes() << std::endl;
-    }
-    fillingBuffer_[kv.first][slot] = kv.second;
-  }
-
+FutureReply Batcher::finishSlot(int slot) {
   // batch has not been extracted yet
   assert(numActiveWrite_ > 0);
   assert(fillingReply_ != nullptr);
   auto reply = fillingReply_;
-  lk.lock();
+  std::unique_lock<std::mutex> lk(mNextSlot_);
   --numActiveWrite_;
   lk.unlock();
   if (numActiveWrite_ == 0) {
@@ -114,38 +169,72 @@ FutureReply Batcher::send(const TensorDict& t) {
 }
 
 // get batch input from batcher
-TensorDict Batcher::get() {
+TensorRecord Batcher::get() {
+  auto packed = getPacked();
+  if (packed.empty()) {
+    return TensorRecord();
+  }
+  return TensorRecord(schema_, packed.unpack());
+}
+
+PackedTensors Batcher::getPacked() {
+  RELA_TRACE_SCOPE("batcher_get");
   std::unique_lock<std::mutex> lk(mNextSlot_);
-  cvGetBatch_.wait(
-      lk, [this] { return (nextSlot_ > 0 && numActiveWrite_ == 0) || exit_; });
+  {
+    ScopedHistogramTimer timer(runnerWaitHist_);
+    cvGetBatch_.wait(
+        lk, [this] { return (nextSlot_ > 0 && numActiveWrite_ == 0) || exit_; });
+  }
 
   if (exit_) {
-    return TensorDict();
+    return PackedTensors();
   }
 
   int bsize = nextSlot_;
   nextSlot_ = 0;
+  ++numBatch_;
+  numData_ += bsize;
+  batchsizeHist_.add(bsize);
   // assert previous reply has been handled
   assert(filledReply_ == nullptr);
   std::swap(fillingBuffer_, filledBuffer_);
   std::swap(fillingReply_, filledReply_);
-  fillingReply_ = std::make_shared<FutureReply_>();
+  fillingReply_ = std::make_shared<FutureReply_>(actorWaitHist_);
 
   lk.unlock();
   cvNextSlot_.notify_all();
 
-  TensorDict batch;
-  for (const auto& kv : filledBuffer_) {
-    batch[kv.first] = kv.second.narrow(0, 0, bsize).contiguous();
+  std::vector<torch::Tensor> fields;
+  for (int i = 0; i < filledBuffer_.size(); ++i) {
+    fields.push_back(filledBuffer_[i].narrow(0, 0, bsize));
   }
+  return PackedTensors(fields, &staging_, pinned_);
+}
 
-  return batch;
+std::unordered_map<std::string, float> Batcher::stats() const {
+  std::unordered_map<std::string, float> stats;
+  stats.merge(batchsizeHist_.stats("batchsize"));
+  stats.merge(actorWaitHist_->stats("actor_wait"));
+  stats.merge(runnerWaitHist_.stats("runner_wait"));
+  stats.merge(forwardHist_.stats("forward"));
+  stats.merge(updateStallHist_.stats("update_stall"));
+  stats["fill_ratio"] = stats["batchsize_mean"] / batchsize_;
+  return stats;
+}
+
+void Batcher::resetStats() {
+  batchsizeHist_.reset();
+  actorWaitHist_->reset();
+  runnerWaitHist_.reset();
+  forwardHist_.reset();
+  updateStallHist_.reset();
 }
 
 // set batch reply for batcher
-void Batcher::set(TensorDict&& t) {
-  for (const auto& kv : t) {
-    assert(kv.second.device().is_cpu());
+void Batcher::set(TensorRecord&& t) {
+  RELA_TRACE_SCOPE("batcher_set");
+  for (int i = 0; i < t.size(); ++i) {
+    assert(t[i].device().is_cpu());
   }
   filledReply_->set(std::move(t));
   filledReply_ = nullptr;
@@ -6,7 +6,12 @@
 //
 #pragma once
 
+#include "rela/histogram.h"
+#include "rela/packed_tensors.h"
+#include "rela/staging_arena.h"
 #include "rela/tensor_dict.h"
+#include "rela/tensor_record.h"
+#include "rela/trace.h"
 #include "rela/utils.h"
 
 namespace rela {
@@ -42,6 +47,9 @@ class FutureReply {
 
   TensorDict get();
 
+  // same as get() but without building a TensorDict
+  TensorRecord getRecord();
+
   bool isNull() const {
     return fut_ == nullptr;
   }
@@ -55,7 +63,9 @@ using Future = FutureReply;
 
 class Batcher {
  public:
-  Batcher(int batchsize);
+  // batches handed out by get() are gathered into recycled staging
+  // buffers, page-locked if pinned
+  Batcher(int batchsize, bool pinned = false);
 
   Batcher(const Batcher&) = delete;
   Batcher& operator=(const Batcher&) = delete;
@@ -79,28 +89,110 @@ class Batcher {
   // send data into batcher
   FutureReply send(const TensorDict& t);
 
+  // same as send(TensorDict), fields are copied by index
+  FutureReply send(const TensorRecord& t);
+
   // get batch input from batcher
-  TensorDict get();
+  TensorRecord get();
+
+  // same as get() but as one packed buffer, empty once terminated. fields
+  // are in the order of schema()
+  PackedTensors getPacked();
+
+  const SchemaPtr& schema() const {
+    return schema_;
+  }
+
+  std::unordered_map<std::string, float> stagingStats() {
+    auto stats = staging_.stats();
+    for (auto& kv : replyStaging_.stats()) {
+      stats["reply_" + kv.first] = kv.second;
+    }
+    return stats;
+  }
+
+  // host buffers for replies computed on a device, see tensor_record::toHost
+  StagingArena& replyStaging() {
+    return replyStaging_;
+  }
+
+  bool pinned() const {
+    return pinned_;
+  }
+
+  // filled by the runner around the model call and around waiting for a
+  // model update to finish, in microseconds
+  Histogram& forwardHist() {
+    return forwardHist_;
+  }
+
+  Histogram& updateStallHist() {
+    return updateStallHist_;
+  }
+
+  // histograms since the last resetStats(): batchsize, actor_wait (actors
+  // blocked in FutureReply::get), runner_wait (runner blocked in get),
+  // forward & update_stall, times in microseconds
+  std::unordered_map<std::string, float> stats() const;
+
+  void resetStats();
 
   // set batch reply for batcher
-  void set(TensorDict&& t);
+  void set(TensorRecord&& t);
+
+  int batchsize() const {
+    return batchsize_;
+  }
+
+  // total number of batches and data points handed out by get()
+  int64_t numBatch() const {
+    return numBatch_;
+  }
+
+  int64_t numData() const {
+    return numData_;
+  }
 
  private:
   const int batchsize_;
+  const bool pinned_;
+  // the runner holds one batch while the next one is gathered
+  StagingArena staging_{4};
+  // actors keep slices of a reply (e.g. the hidden state) until their next
+  // step, so several replies are alive at a time
+  StagingArena replyStaging_{8};
+
+  Histogram batchsizeHist_;
+  Histogram runnerWaitHist_;
+  // shared with the replies, which may outlive a batch
+  std::shared_ptr<Histogram> actorWaitHist_;
+  Histogram forwardHist_;
+  Histogram updateStallHist_;
+
+  // must hold lk on mNextSlot_, returns with lk unlocked
+  int reserveSlot(std::unique_lock<std::mutex>& lk);
+
+  FutureReply finishSlot(int slot);
+
+  // set by the first send, all later sends must have the same fields
+  SchemaPtr schema_;
 
   int nextSlot_;
   int numActiveWrite_;
   std::condition_variable cvNextSlot_;
 
-  TensorDict fillingBuffer_;
+  TensorRecord fillingBuffer_;
   std::shared_ptr<FutureReply_> fillingReply_;
 
-  TensorDict filledBuffer_;
+  TensorRecord filledBuffer_;
   std::shared_ptr<FutureReply_> filledReply_;
 
   bool exit_ = false;
   std::condition_variable cvGetBatch_;
   std::mutex mNextSlot_;
+
+  std::atomic<int64_t> numBatch_{0};
+  std::atomic<int64_t> numData_{0};
 };
 
 }  // namespace rela
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rela/prioritized_replay.h"
+
+namespace rela {
+
+// a set of named PrioritizedReplay buffers, e.g. one per partner, that are
+// filled independently and sampled together. each sample() call takes a
+// fixed share of the batch from every buffer according to the mix set by
+// setMix, importance weights are computed within each buffer and then
+// normalized over the whole batch. sample() waits for buffers that cannot
+// supply their share yet, e.g. a partner whose actors have only just started,
+// until their actors add enough elements
+template <class DataType>
+class CompositeReplay {
+ public:
+  CompositeReplay(int seed, float alpha, float beta)
+      : seed_(seed)
+      , alpha_(alpha)
+      , beta_(beta) {
+  }
+
+  // the returned buffer is handed to the actors that produce its data.
+  // new buffers get a mix ratio of 1
+  std::shared_ptr<PrioritizedReplay<DataType>> addBuffer(
+      const std::string& name, int capacity, EvictionPolicy eviction = EvictionPolicy::kFifo) {
+    assert(buffers_.find(name) == buffers_.end());
+    std::lock_guard<std::mutex> lk(mSampled_);
+    assert(sampledCounts_.empty());
+    auto buffer = std::make_shared<PrioritizedReplay<DataType>>(
+        capacity, seed_ + (int)buffers_.size(), alpha_, beta_, 0, eviction);
+    buffers_[name] = buffer;
+    mix_[name] = 1;
+    numSampled_[name] = 0;
+    return buffer;
+  }
+
+  std::shared_ptr<PrioritizedReplay<DataType>> buffer(const std::string& name) const {
+    return buffers_.at(name);
+  }
+
+  // relative share of each buffer in a batch, buffers not listed get 0
+  void setMix(const std::unordered_map<std::string, float>& mix) {
+    float total = 0;
+    for (auto& kv : mix_) {
+      auto it = mix.find(kv.first);
+      kv.second = it == mix.end() ? 0 : it->second;
+      assert(kv.second >= 0);
+      total += kv.second;
+    }
+    for (auto& kv : mix) {
+      if (mix_.find(kv.first) == mix_.end()) {
+        std::cout << "Error: unknown replay buffer " << kv.first << std::endl;
+        assert(false);
+      }
+    }
+    assert(total > 0);
+  }
+
+  // number of elements taken from each buffer for a batch of batchsize,
+  // rounded with the largest remainder so that they sum up to batchsize
+  std::map<std::string, int> batchCounts(int batchsize) const {
+    float total = 0;
+    for (auto& kv : mix_) {
+      total += kv.second;
+    }
+    std::map<std::string, int> counts;
+    std::vector<std::pair<float, std::string>> remainders;
+    int numAssigned = 0;
+    for (auto& kv : mix_) {
+      float share = batchsize * kv.second / total;
+      counts[kv.first] = (int)std::floor(share);
+      numAssigned += counts[kv.first];
+      remainders.push_back({share - counts[kv.first], kv.first});
+    }
+    std::sort(remainders.begin(), remainders.end(), [](const auto& a, const auto& b) {
+      return a.first > b.first;
+    });
+    for (int i = 0; numAssigned < batchsize; ++i, ++numAssigned) {
+      counts[remainders[i].second] += 1;
+    }
+    return counts;
+  }
+
+  std::tuple<DataType, torch::Tensor> sample(
+      int batchsize, const std::string& device, const std::vector<std::string>& keys = {}) {
+    {
+      std::lock_guard<std::mutex> lk(mSampled_);
+      if (!sampledCounts_.empty()) {
+        std::cout << "Error: previous samples' priority has not been updated." << std::endl;
+        assert(false);
+      }
+    }
+
+    auto counts = batchCounts(batchsize);
+    for (auto& kv : counts) {
+      if (!buffers_[kv.first]->waitSize(kv.second)) {
+        throw std::runtime_error("replay terminated while sampling");
+      }
+    }
+
+    std::vector<DataType> samples;
+    std::vector<torch::Tensor> weights;
+    std::vector<std::pair<std::string, int>> sampledCounts;
+    for (auto& kv : counts) {
+      if (kv.second == 0) {
+        continue;
+      }
+      std::vector<DataType> bufferSamples;
+      torch::Tensor bufferWeights;
+      std::tie(bufferSamples, bufferWeights) = buffers_[kv.first]->sampleElements(kv.second);
+      samples.insert(samples.end(), bufferSamples.begin(), bufferSamples.end());
+      weights.push_back(bufferWeights);
+      sampledCounts.push_back({kv.first, kv.second});
+    }
+    {
+      std::lock_guard<std::mutex> lk(mSampled_);
+      sampledCounts_ = std::move(sampledCounts);
+      for (auto& kv : sampledCounts_) {
+        numSampled_[kv.first] += kv.second;
+      }
+    }
+
+    auto weight = torch::cat(weights, 0);
+    weight /= weight.max();
+    if (device != "cpu") {
+      weight = weight.to(torch::Device(device));
+    }
+    auto batch = makeBatch(samples, device, keys, &staging_);
+    return std::make_tuple(batch, weight);
+  }
+
+  // priority of the last sampled batch, split back to the buffers
+  void updatePriority(const torch::Tensor& priority) {
+    std::vector<std::pair<std::string, int>> sampledCounts;
+    {
+      std::lock_guard<std::mutex> lk(mSampled_);
+      std::swap(sampledCounts, sampledCounts_);
+    }
+    if (priority.size(0) == 0) {
+      for (auto& kv : sampledCounts) {
+        buffers_[kv.first]->updatePriority(priority);
+      }
+      return;
+    }
+
+    assert(priority.dim() == 1);
+    auto cpuPriority = priority.cpu();
+    int offset = 0;
+    for (auto& kv : sampledCounts) {
+      buffers_[kv.first]->updatePriority(cpuPriority.narrow(0, offset, kv.second));
+      offset += kv.second;
+    }
+    assert(offset == priority.size(0));
+  }
+
+  void terminate() {
+    for (auto& kv : buffers_) {
+      kv.second->terminate();
+    }
+  }
+
+  int size() const {
+    int size = 0;
+    for (auto& kv : buffers_) {
+      size += kv.second->size();
+    }
+    return size;
+  }
+
+  int numAdd() const {
+    int numAdd = 0;
+    for (auto& kv : buffers_) {
+      numAdd += kv.second->numAdd();
+    }
+    return numAdd;
+  }
+
+  // per buffer size, #add and #sampled
+  std::unordered_map<std::string, std::unordered_map<std::string, float>> stats() const {
+    std::unordered_map<std::string, std::unordered_map<std::string, float>> stats;
+    std::lock_guard<std::mutex> lk(mSampled_);
+    for (auto& kv : buffers_) {
+      stats[kv.first] = {
+          {"size", (float)kv.second->size()},
+          {"num_add", (float)kv.second->numAdd()},
+          {"num_sampled", (float)numSampled_.at(kv.first)},
+          {"mix", mix_.at(kv.first)},
+      };
+    }
+    return stats;
+  }
+
+ private:
+  const int seed_;
+  const float alpha_;
+  const float beta_;
+
+  // ordered so that a batch always lists the buffers in the same order
+  std::map<std::string, std::shared_ptr<PrioritizedReplay<DataType>>> buffers_;
+  std::map<std::string, float> mix_;
+  // the learner samples and updates priorities, stats may come from another
+  // thread
+  mutable std::mutex mSampled_;
+  std::map<std::string, int64_t> numSampled_;
+  std::vector<std::pair<std::string, int>> sampledCounts_;
+  StagingArena staging_{4};
+};
+
+using RNNCompositeReplay = CompositeReplay<RNNTransition>;
+}  // namespace rela
@@ -31,18 +31,29 @@ int Context::pushThreadLoop(std::shared_ptr<ThreadLoop> env) {
 }
 
 void Context::start() {
+  started_ = true;
   for (int i = 0; i < (int)loops_.size(); ++i) {
     threads_.emplace_back([this, i]() {
       loops_[i]->mainLoop();
+      loops_[i]->markExited();
       ++numTerminatedThread_;
     });
   }
 }
 
 void Context::pause() {
+  auto begin = std::chrono::steady_clock::now();
   for (auto& v : loops_) {
     v->pause();
   }
+  if (started_) {
+    for (auto& v : loops_) {
+      v->waitUntilPaused();
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  lastPauseLatency_ = elapsed.count();
+  ++numPause_;
 }
 
 void Context::resume() {
@@ -8,6 +8,7 @@
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <memory>
 #include <thread>
 #include <vector>
@@ -32,10 +33,21 @@ class Context {
 
   void start();
 
+  // pause all loops and block until every one of them is parked at a safe
+  // point (or has exited), e.g. before swapping models or snapshotting replay
   void pause();
 
   void resume();
 
+  // seconds the last pause() took to reach the barrier
+  double lastPauseLatency() const {
+    return lastPauseLatency_;
+  }
+
+  int numPause() const {
+    return numPause_;
+  }
+
   void join();
 
   bool terminated();
@@ -43,6 +55,8 @@ class Context {
  private:
   bool started_;
   std::atomic<int> numTerminatedThread_;
+  double lastPauseLatency_ = 0;
+  int numPause_ = 0;
   std::vector<std::shared_ptr<ThreadLoop>> loops_;
   std::vector<std::thread> threads_;
 };
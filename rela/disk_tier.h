@@ -0,0 +1,134 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "rela/serialize.h"
+
+namespace rela {
+
+// file backed storage with one fixed size slot per ring slot of
+// ConcurrentQueue. a slot holds [len:int64][serialized element]. the file
+// is mapped shared so that reads go through the page cache and cold
+// elements cost no RAM. the file is removed on destruction. failing to set
+// up the file or an element that does not fit its slot throws
+// std::runtime_error
+template <class DataType>
+class DiskTier {
+ public:
+  DiskTier(const std::string& path, int numSlot, int64_t slotBytes)
+      : path_(path)
+      , numSlot_(numSlot)
+      , slotBytes_(slotBytes)
+      , fileBytes_(numSlot * slotBytes) {
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+      throw std::runtime_error(
+          "cannot create disk tier file " + path + ": " + std::strerror(errno));
+    }
+    if (ftruncate(fd_, fileBytes_) != 0) {
+      fail("cannot resize disk tier file " + path + " to " + std::to_string(fileBytes_));
+    }
+    void* data = mmap(nullptr, fileBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      fail("cannot map disk tier file " + path);
+    }
+    data_ = (char*)data;
+    // the sampler reads slots in random order
+    madvise(data_, fileBytes_, MADV_RANDOM);
+  }
+
+  DiskTier(const DiskTier&) = delete;
+  DiskTier& operator=(const DiskTier&) = delete;
+
+  ~DiskTier() {
+    munmap(data_, fileBytes_);
+    close(fd_);
+    unlink(path_.c_str());
+  }
+
+  void write(int slot, const DataType& data) {
+    assert(slot >= 0 && slot < numSlot_);
+    std::ostringstream os;
+    serialize::Writer writer(os);
+    serialize::write(writer, data);
+    auto bytes = os.str();
+    int64_t len = bytes.size();
+    if (len + (int64_t)sizeof(int64_t) > slotBytes_) {
+      throw std::runtime_error(
+          "element of " + std::to_string(len) + " bytes does not fit into disk slot of " +
+          std::to_string(slotBytes_) + " bytes");
+    }
+    char* p = data_ + slot * slotBytes_;
+    std::memcpy(p, &len, sizeof(int64_t));
+    std::memcpy(p + sizeof(int64_t), bytes.data(), len);
+    ++numWrite_;
+  }
+
+  DataType read(int slot) {
+    assert(slot >= 0 && slot < numSlot_);
+    const char* p = data_ + slot * slotBytes_;
+    int64_t len;
+    std::memcpy(&len, p, sizeof(int64_t));
+    serialize::Reader reader(p + sizeof(int64_t), len);
+    DataType data;
+    serialize::read(reader, data);
+    ++numRead_;
+    return data;
+  }
+
+  // resident_bytes is how much of the file is in the page cache,
+  // major_faults is for the whole process
+  std::unordered_map<std::string, float> stats() const {
+    int64_t pageSize = sysconf(_SC_PAGESIZE);
+    int64_t numPage = (fileBytes_ + pageSize - 1) / pageSize;
+    std::vector<unsigned char> vec(numPage);
+    int64_t resident = 0;
+    if (mincore(data_, fileBytes_, vec.data()) == 0) {
+      for (auto v : vec) {
+        resident += v & 1;
+      }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return {
+        {"num_spill", (float)numWrite_},
+        {"num_disk_read", (float)numRead_},
+        {"file_bytes", (float)fileBytes_},
+        {"resident_bytes", (float)(resident * pageSize)},
+        {"major_faults", (float)usage.ru_majflt},
+    };
+  }
+
+ private:
+  // undo the constructor's work so far and throw
+  [[noreturn]] void fail(const std::string& msg) {
+    auto err = std::string(": ") + std::strerror(errno);
+    close(fd_);
+    unlink(path_.c_str());
+    throw std::runtime_error(msg + err);
+  }
+
+  const std::string path_;
+  const int numSlot_;
+  const int64_t slotBytes_;
+  const int64_t fileBytes_;
+
+  int fd_;
+  char* data_;
+
+  std::atomic<int64_t> numWrite_{0};
+  std::atomic<int64_t> numRead_{0};
+};
+
+}  // namespace rela
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+namespace rela {
+
+// counts of non-negative integer samples (sizes, microseconds) in power of
+// 2 buckets. add() is a few relaxed atomic increments so it can be called
+// from actor threads on every request. quantiles are upper bounds of the
+// bucket they fall in, i.e. accurate to a factor of 2
+class Histogram {
+ public:
+  // bucket 0 holds 0, bucket i holds [2^(i-1), 2^i)
+  static constexpr int kNumBucket = 40;
+
+  Histogram() {
+    reset();
+  }
+
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void add(int64_t value) {
+    if (value < 0) {
+      value = 0;
+    }
+    int bucket = 0;
+    while (bucket < kNumBucket - 1 && (int64_t(1) << bucket) <= value) {
+      ++bucket;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    int64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value)) {
+    }
+  }
+
+  // not atomic with respect to concurrent add(), a few samples may be lost
+  void reset() {
+    for (auto& bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+  }
+
+  int64_t count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  // smallest bucket bound b such that a fraction q of the samples are < b
+  int64_t quantile(float q) const {
+    int64_t total = count();
+    if (total == 0) {
+      return 0;
+    }
+    int64_t cumulative = 0;
+    for (int i = 0; i < kNumBucket; ++i) {
+      cumulative += buckets_[i].load(std::memory_order_relaxed);
+      if (cumulative >= q * total) {
+        return i == 0 ? 0 : std::min(int64_t(1) << i, max_.load());
+      }
+    }
+    return max_.load();
+  }
+
+  // {prefix_count, prefix_mean, prefix_p50, prefix_p90, prefix_p99, prefix_max}
+  std::unordered_map<std::string, float> stats(const std::string& prefix) const {
+    int64_t total = count();
+    return {
+        {prefix + "_count", (float)total},
+        {prefix + "_mean", total == 0 ? 0.0f : sum_.load() / (float)total},
+        {prefix + "_p50", (float)quantile(0.5)},
+        {prefix + "_p90", (float)quantile(0.9)},
+        {prefix + "_p99", (float)quantile(0.99)},
+        {prefix + "_max", (float)max_.load()},
+    };
+  }
+
+ private:
+  std::atomic<int64_t> buckets_[kNumBucket];
+  std::atomic<int64_t> count_;
+  std::atomic<int64_t> sum_;
+  std::atomic<int64_t> max_;
+};
+
+// adds the microseconds between construction and destruction to hist
+class ScopedHistogramTimer {
+ public:
+  ScopedHistogramTimer(Histogram& hist)
+      : hist_(hist)
+      , start_(std::chrono::steady_clock::now()) {
+  }
+
+  ScopedHistogramTimer(const ScopedHistogramTimer&) = delete;
+  ScopedHistogramTimer& operator=(const ScopedHistogramTimer&) = delete;
+
+  ~ScopedHistogramTimer() {
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    hist_.add(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+  }
+
+ private:
+  Histogram& hist_;
+  const std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace rela
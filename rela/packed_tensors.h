@@ -0,0 +1,227 @@
+#pragma once
+
+#include <vector>
+
+#include "rela/staging_arena.h"
+#include "rela/tensor_dict.h"
+#include "rela/tensor_record.h"
+
+namespace rela {
+
+// a list of tensors packed into one contiguous byte buffer, so that moving
+// them between host & device is a single copy. they are unpacked as typed
+// views into the buffer, which the views keep alive
+class PackedTensors {
+ public:
+  PackedTensors() = default;
+
+  // copies the tensors into a new buffer on their (common) device, or into
+  // a host buffer from staging if given
+  explicit PackedTensors(
+      const std::vector<torch::Tensor>& tensors,
+      StagingArena* staging = nullptr,
+      bool pinned = false) {
+    assert(tensors.size() > 0);
+    auto device = tensors[0].device();
+    std::vector<std::vector<int64_t>> sizes;
+    std::vector<torch::Dtype> dtypes;
+    for (auto& t : tensors) {
+      assert(t.device() == device);
+      sizes.push_back(t.sizes().vec());
+      dtypes.push_back(t.scalar_type());
+    }
+    allocate(sizes, dtypes, device, staging, pinned);
+    for (size_t i = 0; i < tensors.size(); ++i) {
+      view(i).copy_(tensors[i]);
+    }
+  }
+
+  // uninitialized tensors of the given sizes & dtypes sharing one buffer,
+  // fill them through unpack()
+  PackedTensors(
+      const std::vector<std::vector<int64_t>>& sizes,
+      const std::vector<torch::Dtype>& dtypes,
+      StagingArena* staging,
+      bool pinned) {
+    allocate(sizes, dtypes, torch::kCPU, staging, pinned);
+  }
+
+  bool empty() const {
+    return fields_.empty();
+  }
+
+  // a copy of the whole buffer on device, or this buffer itself if it is
+  // already there. a staging buffer is then still the arena's slot tensor,
+  // which the unpacked views keep referenced
+  PackedTensors to(const torch::Device& device, bool nonBlocking = false) const {
+    if (buffer_.device() == device) {
+      return *this;
+    }
+    PackedTensors packed;
+    packed.fields_ = fields_;
+    packed.nbytes_ = nbytes_;
+    // staging buffers may be larger than needed
+    packed.buffer_ = buffer_.narrow(0, 0, nbytes_).to(device, nonBlocking);
+    return packed;
+  }
+
+  std::vector<torch::Tensor> unpack() const {
+    std::vector<torch::Tensor> tensors;
+    for (size_t i = 0; i < fields_.size(); ++i) {
+      tensors.push_back(view(i));
+    }
+    return tensors;
+  }
+
+  int64_t nbytes() const {
+    return nbytes_;
+  }
+
+  // sizes of the i-th tensor, without unpacking
+  const std::vector<int64_t>& sizes(int i) const {
+    return fields_[i].sizes;
+  }
+
+ private:
+  struct Field {
+    int64_t offset;
+    std::vector<int64_t> sizes;
+    torch::Dtype dtype;
+  };
+
+  // 64 byte alignment works for every dtype and vectorized kernels
+  static int64_t align(int64_t offset) {
+    return (offset + 63) / 64 * 64;
+  }
+
+  void allocate(
+      const std::vector<std::vector<int64_t>>& sizes,
+      const std::vector<torch::Dtype>& dtypes,
+      const torch::Device& device,
+      StagingArena* staging,
+      bool pinned) {
+    assert(sizes.size() == dtypes.size());
+    int64_t nbytes = 0;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+      nbytes = align(nbytes);
+      fields_.push_back({nbytes, sizes[i], dtypes[i]});
+      int64_t numel = 1;
+      for (auto s : sizes[i]) {
+        numel *= s;
+      }
+      nbytes += numel * c10::elementSize(dtypes[i]);
+    }
+    nbytes_ = nbytes;
+    if (staging != nullptr && device.is_cpu()) {
+      buffer_ = staging->acquire(nbytes, pinned);
+    } else {
+      buffer_ = torch::empty(
+          {nbytes}, torch::TensorOptions().dtype(torch::kUInt8).device(device));
+    }
+  }
+
+  torch::Tensor view(int i) const {
+    const auto& field = fields_[i];
+    auto buffer = buffer_;
+    return torch::from_blob(
+        static_cast<uint8_t*>(buffer_.data_ptr()) + field.offset,
+        field.sizes,
+        [buffer](void*) {},
+        buffer_.options().dtype(field.dtype));
+  }
+
+  std::vector<Field> fields_;
+  int64_t nbytes_ = 0;
+  torch::Tensor buffer_;
+};
+
+// moves the tensors pointed to by fields to device with a single copy,
+// they have to be on the same device
+inline void packedTo(const std::vector<torch::Tensor*>& fields, const torch::Device& device) {
+  if (fields.empty()) {
+    return;
+  }
+  std::vector<torch::Tensor> tensors;
+  for (auto f : fields) {
+    tensors.push_back(*f);
+  }
+  auto moved = PackedTensors(tensors).to(device).unpack();
+  for (size_t i = 0; i < fields.size(); ++i) {
+    *fields[i] = moved[i];
+  }
+}
+
+namespace tensor_record {
+
+// same as calling .to(device) on every field but the fields that are not on
+// device yet are moved with a single copy
+inline TensorRecord packedTo(const TensorRecord& record, const torch::Device& device) {
+  std::vector<int> indices;
+  std::vector<torch::Tensor> tensors;
+  for (int i = 0; i < record.size(); ++i) {
+    if (record[i].device() != device) {
+      indices.push_back(i);
+      tensors.push_back(record[i]);
+    }
+  }
+  if (tensors.empty()) {
+    return record;
+  }
+  for (auto& t : tensors) {
+    if (t.device() != tensors[0].device()) {
+      // spread over several devices, no single buffer to copy
+      TensorRecord result(record.schema());
+      for (int i = 0; i < record.size(); ++i) {
+        result[i] = record[i].to(device);
+      }
+      return result;
+    }
+  }
+  auto moved = PackedTensors(tensors).to(device).unpack();
+  TensorRecord result = record;
+  for (size_t k = 0; k < indices.size(); ++k) {
+    result[indices[k]] = moved[k];
+  }
+  return result;
+}
+
+// record on the cpu. fields on a device (e.g. model outputs) are copied one
+// by one straight into a host buffer from staging, without packing them on
+// the device first. a record that is on the cpu already is returned as is
+inline TensorRecord toHost(const TensorRecord& record, StagingArena* staging, bool pinned) {
+  bool onHost = true;
+  for (int i = 0; i < record.size(); ++i) {
+    onHost = onHost && record[i].device().is_cpu();
+  }
+  if (onHost || record.size() == 0) {
+    return record;
+  }
+  std::vector<std::vector<int64_t>> sizes;
+  std::vector<torch::Dtype> dtypes;
+  for (int i = 0; i < record.size(); ++i) {
+    sizes.push_back(record[i].sizes().vec());
+    dtypes.push_back(record[i].scalar_type());
+  }
+  PackedTensors packed(sizes, dtypes, staging, pinned);
+  auto views = packed.unpack();
+  TensorRecord host(record.schema());
+  for (int i = 0; i < record.size(); ++i) {
+    views[i].copy_(record[i]);
+    host[i] = views[i];
+  }
+  return host;
+}
+
+}  // namespace tensor_record
+
+namespace tensor_dict {
+
+inline TensorDict packedTo(const TensorDict& d, const torch::Device& device) {
+  if (d.empty()) {
+    return d;
+  }
+  return tensor_record::packedTo(TensorRecord::fromDict(d), device).toDict();
+}
+
+}  // namespace tensor_dict
+}  // namespace rela
@@ -6,212 +6,693 @@
 //
 #pragma once
 
+#include <pthread.h>
+
+#include <algorithm>
+#include <chrono>
 #include <cmath>
-#include <future>
+#include <cstdio>
+#include <deque>
+#include <limits>
+#include <memory>
 #include <random>
+#include <stdexcept>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 
+#include "rela/disk_tier.h"
+#include "rela/rate_limiter.h"
+#include "rela/serialize.h"
+#include "rela/staging_arena.h"
 #include "rela/tensor_dict.h"
+#include "rela/trace.h"
 #include "rela/transition.h"
 
 namespace rela {
 
+// min over a fixed size array, O(log n) set and argmin. empty entries are inf
+class MinTree {
+ public:
+  MinTree(int size)
+      : size_(1) {
+    while (size_ < size) {
+      size_ *= 2;
+    }
+    tree_.resize(2 * size_);
+    clear();
+  }
+
+  void set(int i, float v) {
+    i += size_;
+    tree_[i] = v;
+    for (i /= 2; i >= 1; i /= 2) {
+      tree_[i] = std::min(tree_[2 * i], tree_[2 * i + 1]);
+    }
+  }
+
+  void reset(int i) {
+    set(i, kEmpty);
+  }
+
+  int argmin() const {
+    int i = 1;
+    while (i < size_) {
+      i = tree_[2 * i] <= tree_[2 * i + 1] ? 2 * i : 2 * i + 1;
+    }
+    return i - size_;
+  }
+
+  void clear() {
+    std::fill(tree_.begin(), tree_.end(), kEmpty);
+  }
+
+ private:
+  static constexpr float kEmpty = std::numeric_limits<float>::infinity();
+
+  int size_;
+  std::vector<float> tree_;
+};
+
+// which elements are dropped once the buffer is over capacity
+//  - kFifo: the oldest ones
+//  - kLowestPriority: the ones with the lowest priority
+//  - kReservoir: every element ever added is kept with the same probability
+enum class EvictionPolicy { kFifo, kLowestPriority, kReservoir };
+
+// elements on their way to the disk tier, see ConcurrentQueue::takeSpill
+template <class DataType>
+struct SpillBatch {
+  std::vector<int64_t> keys;
+  std::vector<DataType> elements;
+};
+
+// multi-producer ring buffer. producers reserve slots with a CAS on tail_,
+// write them without any lock and publish each slot by storing its position.
+// the consumer side (sampler) advances safeTail_ over published slots, so an
+// episode becomes visible once it and all episodes reserved before it are
+// written. producers only block when the ring is full.
 template <class DataType>
 class ConcurrentQueue {
  public:
-  ConcurrentQueue(int capacity)
+  ConcurrentQueue(int capacity, EvictionPolicy eviction = EvictionPolicy::kFifo)
       : capacity(capacity)
+      , eviction_(eviction)
       , head_(0)
       , tail_(0)
-      , size_(0)
       , safeTail_(0)
-      , safeSize_(0)
       , sum_(0)
-      , evicted_(capacity, false)
+      , published_(new std::atomic<int64_t>[capacity])
+      , generations_(capacity, 0)
       , elements_(capacity)
-      , weights_(capacity, 0) {
+      , weights_(capacity, 0)
+      , lengths_(capacity, 0) {
+    for (int i = 0; i < capacity; ++i) {
+      published_[i].store(-1, std::memory_order_relaxed);
+    }
+    if (eviction_ == EvictionPolicy::kLowestPriority) {
+      minTree_ = std::make_unique<MinTree>(capacity);
+    }
   }
 
+  // number of published elements and their total weight
   int safeSize(float* sum) const {
-    std::unique_lock<std::mutex> lk(m_);
+    std::lock_guard<std::mutex> lk(mConsumer_);
+    advanceSafeTail();
     if (sum != nullptr) {
       *sum = sum_;
     }
-    return safeSize_;
+    return int(safeTail_ - head_);
+  }
+
+  // keep the total weight of each length bucket, bucket b holds lengths in
+  // [edges[b-1], edges[b]). O(size) once, the sums are then kept up to date
+  // along with sum_. empty edges turns it off. consumer side
+  void setLengthBuckets(const std::vector<int>& edges) {
+    std::lock_guard<std::mutex> lk(mConsumer_);
+    advanceSafeTail();
+    bucketEdges_ = edges;
+    bucketSum_.assign(edges.empty() ? 0 : edges.size() + 1, 0);
+    bucketCount_.assign(bucketSum_.size(), 0);
+    for (int64_t pos = head_; pos < safeTail_; ++pos) {
+      addWeight(pos % capacity, 1);
+    }
+  }
+
+  int bucketOf(int length) const {
+    return std::upper_bound(bucketEdges_.begin(), bucketEdges_.end(), length) -
+        bucketEdges_.begin();
+  }
+
+  // total weight of the published elements of each bucket, empty without
+  // length buckets. empty buckets are exactly 0 despite rounding
+  std::vector<double> bucketSums() const {
+    std::lock_guard<std::mutex> lk(mConsumer_);
+    advanceSafeTail();
+    std::vector<double> sums(bucketSum_.size(), 0);
+    for (size_t b = 0; b < sums.size(); ++b) {
+      if (bucketCount_[b] > 0) {
+        sums[b] = std::max(0.0, bucketSum_[b]);
+      }
+    }
+    return sums;
   }
 
+  // number of reserved elements, including ones still being written
   int size() const {
-    std::unique_lock<std::mutex> lk(m_);
-    return size_;
+    return int(tail_.load() - head_.load());
   }
 
+  // keep only the newest hotCapacity published elements in RAM, older ones
+  // are moved to a file at path, see takeSpill. must be called while empty
+  void enableDiskTier(const std::string& path, int hotCapacity, int64_t slotBytes) {
+    assert(size() == 0);
+    disk_ = std::make_unique<DiskTier<DataType>>(path, capacity, slotBytes);
+    onDisk_.assign(capacity, 0);
+    hotCapacity_ = hotCapacity;
+    spillChunk_ = std::max(1, hotCapacity / 16);
+  }
+
+  // whether enough elements fell out of the hot window to be worth a
+  // takeSpill. lock free, may be a little off
+  bool needSpill() const {
+    if (disk_ == nullptr) {
+      return false;
+    }
+    int64_t begin = std::max(spillTail_.load(), head_.load());
+    return tail_.load() - begin >= hotCapacity_ + spillChunk_;
+  }
+
+  // elements to move to disk with writeSpill & commitSpill: the published
+  // ones that fell out of the hot window and the ones evict moved behind it.
+  // consumer side, like blockPop
+  SpillBatch<DataType> takeSpill() {
+    SpillBatch<DataType> batch;
+    if (disk_ == nullptr) {
+      return batch;
+    }
+    std::lock_guard<std::mutex> lk(mConsumer_);
+    advanceSafeTail();
+    int64_t begin = std::max(spillTail_.load(), head_.load());
+    int64_t end = std::max(begin, safeTail_ - hotCapacity_);
+    spillTail_ = end;
+    for (int64_t pos = begin; pos < end; ++pos) {
+      int id = pos % capacity;
+      batch.keys.push_back(keyOf(id));
+      batch.elements.push_back(elements_[id]);
+    }
+    for (auto key : strays_) {
+      int id = key & 0xffffffff;
+      if (key == keyOf(id) && !onDisk_[id]) {
+        batch.keys.push_back(key);
+        batch.elements.push_back(elements_[id]);
+      }
+    }
+    strays_.clear();
+    return batch;
+  }
+
+  // serialize the batch into the disk slots without any lock. the slots are
+  // not marked on disk yet so no one reads them. one batch at a time
+  void writeSpill(const SpillBatch<DataType>& batch) {
+    for (size_t i = 0; i < batch.keys.size(); ++i) {
+      disk_->write(batch.keys[i] & 0xffffffff, batch.elements[i]);
+    }
+  }
+
+  // drop the RAM copy of the batch elements that are still in their slot,
+  // the others were evicted or overwritten since takeSpill. consumer side
+  void commitSpill(const SpillBatch<DataType>& batch) {
+    for (auto key : batch.keys) {
+      int id = key & 0xffffffff;
+      if (key != keyOf(id) || onDisk_[id]) {
+        continue;
+      }
+      elements_[id] = DataType();
+      onDisk_[id] = 1;
+      ++numOnDisk_;
+    }
+  }
+
+  std::unordered_map<std::string, float> diskTierStats() const {
+    if (disk_ == nullptr) {
+      return {};
+    }
+    auto stats = disk_->stats();
+    stats["num_on_disk"] = numOnDisk_;
+    return stats;
+  }
+
+  // not thread-safe against append
   void clear() {
-    std::unique_lock<std::mutex> lk(m_);
+    std::lock_guard<std::mutex> lk(mConsumer_);
     head_ = 0;
     tail_ = 0;
-    size_ = 0;
     safeTail_ = 0;
-    safeSize_ = 0;
     sum_ = 0;
-    std::fill(evicted_.begin(), evicted_.end(), false);
+    std::fill(bucketSum_.begin(), bucketSum_.end(), 0);
+    std::fill(bucketCount_.begin(), bucketCount_.end(), 0);
+    for (int i = 0; i < capacity; ++i) {
+      published_[i].store(-1, std::memory_order_relaxed);
+    }
+    std::fill(generations_.begin(), generations_.end(), 0);
     std::fill(weights_.begin(), weights_.end(), 0.0);
+    std::fill(onDisk_.begin(), onDisk_.end(), 0);
+    spillTail_ = 0;
+    strays_.clear();
+    numOnDisk_ = 0;
+    if (minTree_ != nullptr) {
+      minTree_->clear();
+    }
   }
 
   void terminate() {
-    terminated_ = true;
+    {
+      std::lock_guard<std::mutex> lk(mFull_);
+      terminated_ = true;
+    }
     cvSize_.notify_all();
   }
 
-  void append(const DataType& data, float weight) {
-    int blockSize = 1;
-    std::unique_lock<std::mutex> lk(m_);
-    cvSize_.wait(lk, [=] { return terminated_ || (size_ + blockSize <= capacity); });
-    if (terminated_) {
+  void append(const DataType& data, float weight, int length = 0) {
+    RELA_TRACE_SCOPE("replay_append");
+    int64_t start = reserve(1);
+    if (start < 0) {
       return;
     }
+    write(start, data, weight, length);
+  }
 
-    int start = tail_;
-    int end = (tail_ + blockSize) % capacity;
-
-    tail_ = end;
-    size_ += blockSize;
-    checkSize(head_, tail_, size_);
-
-    lk.unlock();
-
-    float sum = 0;
-    elements_[start] = data;
-    weights_[start] = weight;
-    sum += weight;
-
-    lk.lock();
-
-    cvTail_.wait(lk, [=] { return safeTail_ == start; });
-    safeTail_ = end;
-    safeSize_ += blockSize;
-    sum_ += sum;
-    checkSize(head_, safeTail_, safeSize_);
-
-    lk.unlock();
-    cvTail_.notify_all();
+  // append several elements with a single reservation
+  void appendBlock(
+      const std::vector<DataType>& data,
+      const std::vector<float>& weights,
+      const std::vector<int>& lengths) {
+    assert(data.size() == weights.size() && data.size() == lengths.size());
+    int blockSize = data.size();
+    if (blockSize == 0) {
+      return;
+    }
+    RELA_TRACE_SCOPE("replay_append");
+    int64_t start = reserve(blockSize);
+    if (start < 0) {
+      return;
+    }
+    for (int i = 0; i < blockSize; ++i) {
+      write(start + i, data[i], weights[i], lengths[i]);
+    }
   }
 
   // ------------------------------------------------------------- //
-  // blockPop, update are thread-safe against blockAppend
-  // but they are NOT thread-safe against each other
+  // blockPop, evict, update are thread-safe against append
+  // but they are NOT thread-safe against each other,
+  // PrioritizedReplay only calls them from sample_ under mSampler_
   void blockPop(int blockSize) {
-    double diff = 0;
-    int head = head_;
-    for (int i = 0; i < blockSize; ++i) {
-      diff -= weights_[head];
-      evicted_[head] = true;
-      head = (head + 1) % capacity;
+    {
+      std::lock_guard<std::mutex> lk(mConsumer_);
+      advanceSafeTail();
+      assert(blockSize <= safeTail_ - head_);
+      int64_t head = head_;
+      for (int i = 0; i < blockSize; ++i) {
+        int id = head % capacity;
+        addWeight(id, -1);
+        release(id);
+        ++head;
+      }
+      head_ = head;
     }
+    {
+      std::lock_guard<std::mutex> lk(mFull_);
+    }
+    cvSize_.notify_all();
+  }
 
+  // drop num elements according to the eviction policy. the ring only
+  // frees slots at the head, so victims elsewhere are overwritten by the
+  // surviving elements of the first num slots, which are then popped
+  void evict(int num, std::mt19937& rng) {
+    if (eviction_ == EvictionPolicy::kFifo) {
+      blockPop(num);
+      return;
+    }
     {
-      std::lock_guard<std::mutex> lk(m_);
-      sum_ += diff;
-      head_ = head;
-      safeSize_ -= blockSize;
-      size_ -= blockSize;
-      assert(safeSize_ >= 0);
-      checkSize(head_, safeTail_, safeSize_);
+      std::lock_guard<std::mutex> lk(mConsumer_);
+      advanceSafeTail();
+      assert(num <= safeTail_ - head_);
+      std::vector<int64_t> victims;
+      if (eviction_ == EvictionPolicy::kLowestPriority) {
+        victims = lowestVictims(num);
+      } else {
+        victims = reservoirVictims(num, rng);
+      }
+      popVictims(victims);
+    }
+    {
+      std::lock_guard<std::mutex> lk(mFull_);
     }
     cvSize_.notify_all();
   }
 
-  void update(const std::vector<int>& ids, const torch::Tensor& weights) {
+  // keys come from getWeight, keys of elements that have left their slot
+  // since are skipped
+  void update(const std::vector<int64_t>& keys, const torch::Tensor& weights) {
     double diff = 0;
+    std::vector<double> bucketDiff(bucketSum_.size(), 0);
     auto weightAcc = weights.accessor<float, 1>();
-    for (int i = 0; i < (int)ids.size(); ++i) {
-      auto id = ids[i];
-      if (evicted_[id]) {
+    std::vector<int> ids;
+    ids.reserve(keys.size());
+    for (int i = 0; i < (int)keys.size(); ++i) {
+      int id = keys[i] & 0xffffffff;
+      if (keys[i] != keyOf(id)) {
         continue;
       }
       diff += (weightAcc[i] - weights_[id]);
+      if (!bucketDiff.empty()) {
+        bucketDiff[bucketOf(lengths_[id])] += weightAcc[i] - weights_[id];
+      }
       weights_[id] = weightAcc[i];
+      ids.push_back(id);
     }
 
-    std::lock_guard<std::mutex> lk_(m_);
+    std::lock_guard<std::mutex> lk(mConsumer_);
     sum_ += diff;
+    for (size_t b = 0; b < bucketDiff.size(); ++b) {
+      bucketSum_[b] += bucketDiff[b];
+    }
+    if (minTree_ != nullptr) {
+      for (auto id : ids) {
+        minTree_->set(id, weights_[id]);
+      }
+    }
   }
 
   // ------------------------------------------------------------- //
   // accessing elements is never locked, operate safely!
   DataType get(int idx) {
     int id = (head_ + idx) % capacity;
-    return elements_[id];
+    return element(id);
   }
 
-  DataType getElementAndMark(int idx) {
+  // key identifies the element for a later update
+  float getWeight(int idx, int64_t* key) {
+    assert(key != nullptr);
     int id = (head_ + idx) % capacity;
-    evicted_[id] = false;
-    return elements_[id];
+    *key = keyOf(id);
+    return weights_[id];
   }
 
-  float getWeight(int idx, int* id) {
-    assert(id != nullptr);
-    *id = (head_ + idx) % capacity;
-    return weights_[*id];
+  int getLength(int idx) {
+    int id = (head_ + idx) % capacity;
+    return lengths_[id];
+  }
+
+  // the element at idx if it is in RAM, false if it is on disk
+  bool peek(int idx, DataType* data) {
+    int id = (head_ + idx) % capacity;
+    if (disk_ != nullptr && onDisk_[id]) {
+      return false;
+    }
+    *data = elements_[id];
+    return true;
+  }
+
+  // the element a key from getWeight refers to, false if it has left its
+  // slot since
+  bool getByKey(int64_t key, DataType* data) {
+    int id = key & 0xffffffff;
+    if (key != keyOf(id)) {
+      return false;
+    }
+    *data = element(id);
+    return true;
   }
 
   const int capacity;
 
  private:
-  void checkSize(int head, int tail, int size) {
-    if (size == 0) {
-      assert(tail == head);
-    } else if (tail > head) {
-      if (tail - head != size) {
-        std::cout << "tail-head: " << tail - head << " vs size: " << size << std::endl;
+  DataType element(int id) {
+    if (disk_ != nullptr && onDisk_[id]) {
+      return disk_->read(id);
+    }
+    return elements_[id];
+  }
+
+  // slot id in the low 32 bits, the slot's generation in the high ones
+  int64_t keyOf(int id) const {
+    return (generations_[id] << 32) | id;
+  }
+
+  // mark a popped slot, pending updates to it are dropped. must hold
+  // mConsumer_
+  void release(int id) {
+    ++generations_[id];
+    if (disk_ != nullptr && onDisk_[id]) {
+      onDisk_[id] = 0;
+      --numOnDisk_;
+    }
+    if (minTree_ != nullptr) {
+      minTree_->reset(id);
+    }
+  }
+
+  // must hold mConsumer_
+  std::vector<int64_t> lowestVictims(int num) {
+    std::vector<int64_t> victims;
+    int headId = head_ % capacity;
+    for (int i = 0; i < num; ++i) {
+      int id = minTree_->argmin();
+      minTree_->reset(id);
+      victims.push_back(head_ + (id - headId + capacity) % capacity);
+    }
+    return victims;
+  }
+
+  // the element at position p is the (p + 1)-th one ever added, it replaces
+  // a random older element with prob keep / (p + 1) and is dropped otherwise.
+  // the distinct older victims are drawn with Floyd's algorithm, one draw
+  // per replacement. must hold mConsumer_
+  std::vector<int64_t> reservoirVictims(int num, std::mt19937& rng) {
+    int64_t firstNew = safeTail_ - num;
+    int64_t keep = firstNew - head_;
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::vector<int64_t> victims;
+    int64_t numReplace = 0;
+    for (int64_t pos = firstNew; pos < safeTail_; ++pos) {
+      if (numReplace < keep && coin(rng) * (pos + 1) < keep) {
+        ++numReplace;
+      } else {
+        victims.push_back(pos);
       }
-      assert(tail - head == size);
-    } else {
-      if (tail + capacity - head != size) {
-        std::cout << "tail-head: " << tail + capacity - head << " vs size: " << size
-                  << std::endl;
+    }
+    std::unordered_set<int64_t> chosen;
+    for (int64_t j = keep - numReplace; j < keep; ++j) {
+      int64_t t = std::uniform_int_distribution<int64_t>(0, j)(rng);
+      if (!chosen.insert(t).second) {
+        chosen.insert(j);
+        t = j;
       }
-      assert(tail + capacity - head == size);
+      victims.push_back(head_ + t);
     }
+    return victims;
   }
 
-  mutable std::mutex m_;
-  std::condition_variable cvSize_;
-  std::condition_variable cvTail_;
+  // pop the first victims.size() slots after moving every surviving element
+  // among them into a victim slot further back. must hold mConsumer_
+  void popVictims(const std::vector<int64_t>& victims) {
+    int num = victims.size();
+    int64_t popEnd = head_ + num;
+    std::unordered_set<int64_t> victimSet(victims.begin(), victims.end());
+    std::vector<int64_t> targets;
+    for (auto pos : victims) {
+      assert(pos >= head_ && pos < safeTail_);
+      if (pos >= popEnd) {
+        targets.push_back(pos);
+      }
+    }
 
-  int head_;
-  int tail_;
-  int size_;
+    auto target = targets.begin();
+    for (int64_t pos = head_; pos < popEnd; ++pos) {
+      int id = pos % capacity;
+      if (victimSet.count(pos)) {
+        addWeight(id, -1);
+      } else {
+        assert(target != targets.end());
+        move(id, *target);
+        ++target;
+      }
+      release(id);
+    }
+    assert(target == targets.end());
+    head_ = popEnd;
+  }
 
-  int safeTail_;
-  int safeSize_;
-  double sum_;
-  std::vector<bool> evicted_;
+  // overwrite the element at position dst with the one in slot src. an
+  // element moved behind the hot window stays in RAM until the next spill
+  void move(int src, int64_t dst) {
+    int id = dst % capacity;
+    addWeight(id, -1);
+    elements_[id] = element(src);
+    if (disk_ != nullptr && onDisk_[id]) {
+      onDisk_[id] = 0;
+      --numOnDisk_;
+    }
+    weights_[id] = weights_[src];
+    lengths_[id] = lengths_[src];
+    // updates queued for the element that was there must not apply
+    ++generations_[id];
+    if (disk_ != nullptr && dst < spillTail_) {
+      strays_.push_back(keyOf(id));
+    }
+    if (minTree_ != nullptr) {
+      minTree_->set(id, weights_[id]);
+    }
+  }
+
+  // returns the position of the first reserved slot, -1 if terminated
+  int64_t reserve(int blockSize) {
+    assert(blockSize <= capacity);
+    int64_t tail = tail_.load();
+    while (true) {
+      if (terminated_) {
+        return -1;
+      }
+      if (tail + blockSize - head_.load() > capacity) {
+        std::unique_lock<std::mutex> lk(mFull_);
+        cvSize_.wait(lk, [&] {
+          return terminated_ || tail_.load() + blockSize - head_.load() <= capacity;
+        });
+        if (terminated_) {
+          return -1;
+        }
+        tail = tail_.load();
+        continue;
+      }
+      if (tail_.compare_exchange_weak(tail, tail + blockSize)) {
+        return tail;
+      }
+    }
+  }
+
+  void write(int64_t pos, const DataType& data, float weight, int length) {
+    int id = pos % capacity;
+    elements_[id] = data;
+    weights_[id] = weight;
+    lengths_[id] = length;
+    published_[id].store(pos, std::memory_order_release);
+  }
+
+  // count the element in slot id in (sign 1) or out (sign -1) of sum_ and
+  // its bucket. must hold mConsumer_
+  void addWeight(int id, int sign) const {
+    sum_ += sign * weights_[id];
+    if (!bucketSum_.empty()) {
+      int b = bucketOf(lengths_[id]);
+      bucketSum_[b] += sign * weights_[id];
+      bucketCount_[b] += sign;
+    }
+  }
+
+  // must hold mConsumer_
+  void advanceSafeTail() const {
+    while (safeTail_ < tail_.load()) {
+      int id = safeTail_ % capacity;
+      if (published_[id].load(std::memory_order_acquire) != safeTail_) {
+        break;
+      }
+      addWeight(id, 1);
+      if (minTree_ != nullptr) {
+        minTree_->set(id, weights_[id]);
+      }
+      ++safeTail_;
+    }
+  }
+
+  const EvictionPolicy eviction_;
+
+  // head_ only moves in blockPop & evict, tail_ is the reservation cursor
+  std::atomic<int64_t> head_;
+  std::atomic<int64_t> tail_;
+
+  // consumer side, guarded by mConsumer_
+  mutable std::mutex mConsumer_;
+  mutable int64_t safeTail_;
+  mutable double sum_;
+  // per length bucket sum_ and number of elements, see setLengthBuckets
+  std::vector<int> bucketEdges_;
+  mutable std::vector<double> bucketSum_;
+  mutable std::vector<int64_t> bucketCount_;
+
+  // producers wait here only when the ring is full
+  std::mutex mFull_;
+  std::condition_variable cvSize_;
+  std::atomic_bool terminated_{false};
+
+  std::unique_ptr<std::atomic<int64_t>[]> published_;
+  // bumped whenever a slot loses its element, so that deferred updates can
+  // tell a reused slot apart. consumer side only
+  std::vector<int64_t> generations_;
 
   std::vector<DataType> elements_;
   std::vector<float> weights_;
+  std::vector<int> lengths_;
+  // lowest weight of the published elements, only for kLowestPriority
+  std::unique_ptr<MinTree> minTree_;
 
-  bool terminated_ = false;
+  // optional disk tier, onDisk_ and strays_ belong to the consumer side.
+  // spillTail_ is the end of the elements taken by takeSpill so far
+  std::unique_ptr<DiskTier<DataType>> disk_;
+  int hotCapacity_ = 0;
+  int spillChunk_ = 1;
+  std::vector<uint8_t> onDisk_;
+  std::atomic<int64_t> spillTail_{0};
+  std::vector<int64_t> strays_;
+  std::atomic<int64_t> numOnDisk_{0};
 };
 
+// sequence length used for length bucketing, 0 for non sequential data
+inline int seqLenOf(const RNNTransition& transition) {
+  return transition.reward.size(0);
+}
+
+template <class DataType>
+int seqLenOf(const DataType&) {
+  return 0;
+}
+
 template <class DataType>
 class PrioritizedReplay {
  public:
-  PrioritizedReplay(int capacity, int seed, float alpha, float beta, int prefetch)
+  PrioritizedReplay(
+      int capacity,
+      int seed,
+      float alpha,
+      float beta,
+      int prefetch,
+      EvictionPolicy eviction = EvictionPolicy::kFifo)
       : alpha_(alpha)  // priority exponent
       , beta_(beta)    // importance sampling exponent
       , prefetch_(prefetch)
       , capacity_(capacity)
-      , storage_(int(1.25 * capacity))
+      , storage_(int(1.25 * capacity), eviction)
       , numAdd_(0) {
     rng_.seed(seed);
   }
 
+  ~PrioritizedReplay() {
+    if (rateLimiter_ != nullptr) {
+      rateLimiter_->terminate();
+    }
+    stopWorkers();
+    waitSave();
+  }
+
   void clear() {
     assert(sampledIds_.empty());
-    while (!futures_.empty()) {
-      futures_.pop();
+    stopWorkers();
+    {
+      std::lock_guard<std::mutex> lk(mPending_);
+      pendingIds_.clear();
+      pendingWeights_.clear();
     }
     storage_.clear();
     numAdd_ = 0;
@@ -219,11 +700,89 @@ class PrioritizedReplay {
 
   void terminate() {
     storage_.terminate();
+    if (rateLimiter_ != nullptr) {
+      rateLimiter_->terminate();
+    }
+    {
+      std::lock_guard<std::mutex> lk(mSizeWait_);
+      terminated_ = true;
+    }
+    cvSizeWait_.notify_all();
+    stopWorkers();
+  }
+
+  // block until at least n elements are published, false if terminated
+  // first. woken by the actors, see notifySize_
+  bool waitSize(int n) {
+    std::unique_lock<std::mutex> lk(mSizeWait_);
+    ++numSizeWaiter_;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cvSizeWait_.wait(lk, [&] { return terminated_ || size() >= n; });
+    --numSizeWaiter_;
+    return !terminated_;
+  }
+
+  // throttle whichever of actors (add) and learner (sample) runs ahead, see
+  // RateLimiter. a batch counts as sampled when the sampler produces it, so
+  // prefetched batches are counted early. must be set before any add/sample
+  void setRateLimit(float samplesPerInsert, int minSizeToSample, float errorBuffer) {
+    assert(numAdd_ == 0);
+    rateLimiter_ =
+        std::make_unique<RateLimiter>(samplesPerInsert, minSizeToSample, errorBuffer);
+  }
+
+  // see RateLimiter::suspendInsertLimit, no-op without a rate limit
+  void suspendInsertLimit(bool suspend) {
+    if (rateLimiter_ != nullptr) {
+      rateLimiter_->suspendInsertLimit(suspend);
+    }
+  }
+
+  std::unordered_map<std::string, float> rateLimitStats() {
+    if (rateLimiter_ == nullptr) {
+      return {};
+    }
+    return rateLimiter_->stats();
+  }
+
+  // numWorker threads keep up to depth sampled batches (already moved to
+  // the target device) ready for sample(). worker i is pinned to
+  // cpus[i % cpus.size()] if cpus is not empty. only used when prefetch > 0,
+  // depth defaults to prefetch and numWorker to 1
+  void configureSampler(int numWorker, int depth, const std::vector<int>& cpus) {
+    assert(numWorker > 0 && depth > 0);
+    stopWorkers();
+    numWorker_ = numWorker;
+    depth_ = depth;
+    cpus_ = cpus;
+  }
+
+  // num_starved counts sample() calls that found no ready batch,
+  // starved_sec is the total time they waited. staging_* are the counters
+  // of the buffers batches are gathered into, see StagingArena
+  std::unordered_map<std::string, float> samplerStats() {
+    std::unordered_map<std::string, float> stats;
+    for (auto& kv : staging_.stats()) {
+      stats["staging_" + kv.first] = kv.second;
+    }
+    std::lock_guard<std::mutex> lk(mReady_);
+    stats["num_sample"] = numSample_;
+    stats["num_starved"] = numStarved_;
+    stats["starved_sec"] = starvedSec_;
+    stats["ready"] = ready_.size();
+    stats["num_worker"] = numWorker_;
+    stats["depth"] = depth_;
+    return stats;
   }
 
   void add(const DataType& sample, float priority) {
+    if (rateLimiter_ != nullptr && !rateLimiter_->awaitInsert(1)) {
+      return;
+    }
     numAdd_ += 1;
-    storage_.append(sample, std::pow(priority, alpha_));
+    storage_.append(sample, std::pow(priority, alpha_), seqLenOf(sample));
+    notifySize_();
+    spill_();
   }
 
   void add(const DataType& sample) {
@@ -231,7 +790,26 @@ class PrioritizedReplay {
     add(sample, priority);
   }
 
-  std::tuple<DataType, torch::Tensor> sample(int batchsize, const std::string& device) {
+  void addBlock(const std::vector<DataType>& samples, const std::vector<float>& priorities) {
+    assert(samples.size() == priorities.size());
+    if (rateLimiter_ != nullptr && !rateLimiter_->awaitInsert(samples.size())) {
+      return;
+    }
+    numAdd_ += samples.size();
+    std::vector<float> weights(samples.size());
+    std::vector<int> lengths(samples.size());
+    for (size_t i = 0; i < samples.size(); ++i) {
+      weights[i] = std::pow(priorities[i], alpha_);
+      lengths[i] = seqLenOf(samples[i]);
+    }
+    storage_.appendBlock(samples, weights, lengths);
+    notifySize_();
+    spill_();
+  }
+
+  // keys restricts the batch to the given fields, see makeBatch
+  std::tuple<DataType, torch::Tensor> sample(
+      int batchsize, const std::string& device, const std::vector<std::string>& keys = {}) {
     if (!sampledIds_.empty()) {
       std::cout << "Error: previous samples' priority has not been updated." << std::endl;
       assert(false);
@@ -240,30 +818,61 @@ class PrioritizedReplay {
     DataType batch;
     torch::Tensor priority;
     if (prefetch_ == 0) {
-      std::tie(batch, priority, sampledIds_) = sample_(batchsize, device);
+      std::tie(batch, priority, sampledIds_) = sample_(batchsize, device, keys);
+      if (sampledIds_.empty()) {
+        throw std::runtime_error("replay terminated while sampling");
+      }
       return std::make_tuple(batch, priority);
     }
 
-    if (futures_.empty()) {
-      std::tie(batch, priority, sampledIds_) = sample_(batchsize, device);
-    } else {
-      std::tie(batch, priority, sampledIds_) = futures_.front().get();
-      futures_.pop();
+    if (workers_.empty() || batchsize != workerBatchsize_ || device != workerDevice_ ||
+        keys != workerKeys_) {
+      stopWorkers();
+      startWorkers(batchsize, device, keys);
     }
 
-    while ((int)futures_.size() < prefetch_) {
-      auto f = std::async(
-          std::launch::async,
-          &PrioritizedReplay<DataType>::sample_,
-          this,
-          batchsize,
-          device);
-      futures_.push(std::move(f));
+    std::unique_lock<std::mutex> lk(mReady_);
+    if (ready_.empty()) {
+      ++numStarved_;
+      auto begin = std::chrono::steady_clock::now();
+      cvReady_.wait(lk, [this] { return !ready_.empty(); });
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+      starvedSec_ += elapsed.count();
+    }
+    std::tie(batch, priority, sampledIds_) = std::move(ready_.front());
+    ready_.pop_front();
+    ++numSample_;
+    lk.unlock();
+    cvReady_.notify_all();
+    // workers hand out empty batches once the rate limiter is terminated
+    if (sampledIds_.empty()) {
+      throw std::runtime_error("replay terminated while sampling");
     }
 
     return std::make_tuple(batch, priority);
   }
 
+  // like sample() but returns the sampled elements and their importance
+  // weights before normalization, e.g. to merge with other buffers before
+  // makeBatch. requires prefetch == 0, updatePriority works as for sample()
+  std::tuple<std::vector<DataType>, torch::Tensor> sampleElements(int batchsize) {
+    assert(prefetch_ == 0);
+    assert(sampledIds_.empty());
+    std::vector<DataType> samples;
+    torch::Tensor weights;
+    if (!sampleElements_(batchsize, &samples, &weights, &sampledIds_)) {
+      throw std::runtime_error("replay terminated while sampling");
+    }
+    return std::make_tuple(samples, weights);
+  }
+
+  // priority of the last sampled batch. the update is only queued and never
+  // waits for the sampler, it is applied at the start of the next sample_
+  // (by a sampler worker if prefetch > 0). so:
+  //  - batches that are already prefetched still use the old priorities
+  //  - updates are applied in the order they were made
+  //  - updates for elements evicted in between are dropped, also when their
+  //    slot has been reused and sampled again
   void updatePriority(const torch::Tensor& priority) {
     if (priority.size(0) == 0) {
       sampledIds_.clear();
@@ -275,8 +884,9 @@ class PrioritizedReplay {
 
     auto weights = torch::pow(priority, alpha_);
     {
-      std::lock_guard<std::mutex> lk(mSampler_);
-      storage_.update(sampledIds_, weights);
+      std::lock_guard<std::mutex> lk(mPending_);
+      pendingIds_.push_back(std::move(sampledIds_));
+      pendingWeights_.push_back(weights);
     }
     sampledIds_.clear();
   }
@@ -285,6 +895,138 @@ class PrioritizedReplay {
     return storage_.get(idx);
   }
 
+  // write all elements & priorities to path in a background thread. the
+  // sampler is only locked while taking the element handles and then for
+  // each disk tier read, actors are never blocked. elements on disk that
+  // are evicted before the thread reaches them are left out. the file is
+  // written to path.tmp and renamed once complete
+  void save(const std::string& path) {
+    waitSave();
+    std::vector<DataType> elements;
+    std::vector<float> weights;
+    // key of each element that is on disk, -1 for the ones in RAM
+    std::vector<int64_t> diskKeys;
+    {
+      std::lock_guard<std::mutex> lk(mSampler_);
+      applyPendingUpdates();
+      int size = storage_.safeSize(nullptr);
+      elements.resize(size);
+      weights.reserve(size);
+      diskKeys.reserve(size);
+      for (int i = 0; i < size; ++i) {
+        int64_t key = 0;
+        weights.push_back(storage_.getWeight(i, &key));
+        diskKeys.push_back(storage_.peek(i, &elements[i]) ? -1 : key);
+      }
+    }
+    saveThread_ = std::thread([this,
+                               path,
+                               elements = std::move(elements),
+                               weights = std::move(weights),
+                               diskKeys = std::move(diskKeys)]() {
+      auto tmpPath = path + ".tmp";
+      {
+        serialize::Writer writer(tmpPath);
+        writer.write(kMagic);
+        writer.write<float>(alpha_);
+        auto numPos = writer.tell();
+        int64_t num = 0;
+        writer.write<int64_t>(num);
+        for (size_t i = 0; i < elements.size() && writer.good(); ++i) {
+          if (diskKeys[i] < 0) {
+            writer.write<float>(weights[i]);
+            serialize::write(writer, elements[i]);
+            ++num;
+            continue;
+          }
+          DataType element;
+          {
+            std::lock_guard<std::mutex> lk(mSampler_);
+            if (!storage_.getByKey(diskKeys[i], &element)) {
+              continue;
+            }
+          }
+          writer.write<float>(weights[i]);
+          serialize::write(writer, element);
+          ++num;
+        }
+        writer.writeAt<int64_t>(numPos, num);
+        // e.g. disk full, the previous snapshot stays in place
+        if (!writer.flush()) {
+          std::cout << "Error: failed to write " << tmpPath << ", " << path
+                    << " is not updated" << std::endl;
+          std::remove(tmpPath.c_str());
+          return;
+        }
+      }
+      std::rename(tmpPath.c_str(), path.c_str());
+    });
+  }
+
+  // block until the last save is done
+  void waitSave() {
+    if (saveThread_.joinable()) {
+      saveThread_.join();
+    }
+  }
+
+  // add elements saved by save(), keeps the most recent capacity ones.
+  // call before actors start, priorities are converted if alpha changed.
+  // the elements never wait for the rate limiter, see RateLimiter::restore.
+  // throws std::runtime_error if path is not a complete snapshot
+  void load(const std::string& path) {
+    serialize::Reader reader(path);
+    auto magic = reader.read<uint64_t>();
+    if (magic != kMagic) {
+      throw std::runtime_error(path + " is not a replay snapshot");
+    }
+    float alpha = reader.read<float>();
+    int64_t num = reader.read<int64_t>();
+    int64_t skip = std::max<int64_t>(0, num - capacity_);
+    for (int64_t i = 0; i < num; ++i) {
+      float weight = reader.read<float>();
+      DataType element;
+      serialize::read(reader, element);
+      if (i < skip) {
+        continue;
+      }
+      if (alpha != alpha_) {
+        weight = std::pow(weight, alpha_ / alpha);
+      }
+      storage_.append(element, weight, seqLenOf(element));
+      numAdd_ += 1;
+    }
+    spill_();
+    if (rateLimiter_ != nullptr) {
+      rateLimiter_->restore(num - skip);
+    }
+  }
+
+  // two tier storage: the newest hotCapacity elements stay in RAM, older
+  // ones are spilled by the actors to a memory-mapped file at path with one
+  // slotBytes slot per element, in chunks of hotCapacity / 16. priorities
+  // stay in RAM. call before any add
+  void enableDiskTier(const std::string& path, int hotCapacity, int64_t slotBytes) {
+    assert(numAdd_ == 0);
+    std::lock_guard<std::mutex> lk(mSampler_);
+    storage_.enableDiskTier(path, hotCapacity, slotBytes);
+  }
+
+  std::unordered_map<std::string, float> diskTierStats() const {
+    return storage_.diskTierStats();
+  }
+
+  // draw each batch from a single length bucket so that the batch is only
+  // padded to similar lengths. bucket b holds lengths in [edges[b-1], edges[b]),
+  // empty edges turns it off. b is picked with prob S_b / S and then samples
+  // are drawn proportionally within b, so every element is still sampled
+  // with p_i / S and the importance weights are unchanged
+  void setLengthBuckets(const std::vector<int>& edges) {
+    assert(std::is_sorted(edges.begin(), edges.end()));
+    std::lock_guard<std::mutex> lk(mSampler_);
+    storage_.setLengthBuckets(edges);
+  }
+
   int size() const {
     return storage_.safeSize(nullptr);
   }
@@ -294,36 +1036,195 @@ class PrioritizedReplay {
   }
 
  private:
-  using SampleWeightIds = std::tuple<DataType, torch::Tensor, std::vector<int>>;
+  static constexpr uint64_t kMagic = 0x315950455241454c;  // "LEAREPY1"
+
+  using SampleWeightIds = std::tuple<DataType, torch::Tensor, std::vector<int64_t>>;
+
+  void startWorkers(
+      int batchsize, const std::string& device, const std::vector<std::string>& keys) {
+    assert(workers_.empty());
+    workerBatchsize_ = batchsize;
+    workerDevice_ = device;
+    workerKeys_ = keys;
+    int depth = depth_ > 0 ? depth_ : prefetch_;
+    depth_ = depth;
+    for (int i = 0; i < numWorker_; ++i) {
+      workers_.emplace_back([this, depth]() {
+        RELA_TRACE_THREAD("replay_sampler");
+        while (true) {
+          {
+            std::unique_lock<std::mutex> lk(mReady_);
+            cvReady_.wait(lk, [&] {
+              return stopWorker_ || (int)ready_.size() + numInFlight_ < depth;
+            });
+            if (stopWorker_) {
+              return;
+            }
+            ++numInFlight_;
+          }
+          auto sample = sample_(workerBatchsize_, workerDevice_, workerKeys_);
+          {
+            std::lock_guard<std::mutex> lk(mReady_);
+            --numInFlight_;
+            ready_.push_back(std::move(sample));
+          }
+          cvReady_.notify_all();
+        }
+      });
+      if (cpus_.size() > 0) {
+        pinThread(workers_.back(), cpus_[i % cpus_.size()]);
+      }
+    }
+  }
+
+  // finish in-flight samples, join the workers and drop the ready batches
+  void stopWorkers() {
+    {
+      std::lock_guard<std::mutex> lk(mReady_);
+      stopWorker_ = true;
+    }
+    cvReady_.notify_all();
+    if (rateLimiter_ != nullptr) {
+      // workers may wait for the actors to catch up
+      rateLimiter_->interrupt();
+    }
+    for (auto& t : workers_) {
+      t.join();
+    }
+    workers_.clear();
+    std::lock_guard<std::mutex> lk(mReady_);
+    ready_.clear();
+    stopWorker_ = false;
+  }
+
+  static void pinThread(std::thread& t, int cpu) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    int rc = pthread_setaffinity_np(t.native_handle(), sizeof(cpu_set_t), &cpuset);
+    if (rc != 0) {
+      std::cout << "Warning: failed to pin sampler thread to cpu " << cpu << std::endl;
+    }
+  }
+
+  // wake waitSize, only takes the lock if someone waits. the fences pair
+  // the published element with the waiter count
+  void notifySize_() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (numSizeWaiter_ == 0) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lk(mSizeWait_);
+    }
+    cvSizeWait_.notify_all();
+  }
+
+  // move the elements that fell out of the hot window to disk. called by
+  // the actors after adding, one of them spills at a time and the others
+  // move on. the sampler is only locked to take and to commit the batch,
+  // not while it is written
+  void spill_() {
+    if (!storage_.needSpill()) {
+      return;
+    }
+    std::unique_lock<std::mutex> lkSpill(mSpill_, std::try_to_lock);
+    if (!lkSpill.owns_lock()) {
+      return;
+    }
+    SpillBatch<DataType> batch;
+    {
+      std::lock_guard<std::mutex> lk(mSampler_);
+      batch = storage_.takeSpill();
+    }
+    storage_.writeSpill(batch);
+    std::lock_guard<std::mutex> lk(mSampler_);
+    storage_.commitSpill(batch);
+  }
+
+  // must hold mSampler_
+  void applyPendingUpdates() {
+    std::vector<std::vector<int64_t>> ids;
+    std::vector<torch::Tensor> weights;
+    {
+      std::lock_guard<std::mutex> lk(mPending_);
+      std::swap(ids, pendingIds_);
+      std::swap(weights, pendingWeights_);
+    }
+    for (size_t i = 0; i < ids.size(); ++i) {
+      storage_.update(ids[i], weights[i]);
+    }
+  }
 
-  SampleWeightIds sample_(int batchsize, const std::string& device) {
+  SampleWeightIds sample_(
+      int batchsize, const std::string& device, const std::vector<std::string>& keys) {
+    RELA_TRACE_SCOPE("replay_sample");
+    std::vector<DataType> samples;
+    torch::Tensor weights;
+    std::vector<int64_t> ids;
+    if (!sampleElements_(batchsize, &samples, &weights, &ids)) {
+      return SampleWeightIds();
+    }
+    weights /= weights.max();
+    if (device != "cpu") {
+      weights = weights.to(torch::Device(device));
+    }
+    auto batch = makeBatch(samples, device, keys, &staging_);
+    return std::make_tuple(batch, weights, ids);
+  }
+
+  // draws batchsize elements and their unnormalized importance weights,
+  // false if the rate limiter gave up
+  bool sampleElements_(
+      int batchsize,
+      std::vector<DataType>* outSamples,
+      torch::Tensor* outWeights,
+      std::vector<int64_t>* outIds) {
+    if (rateLimiter_ != nullptr && !rateLimiter_->awaitSample(batchsize, &stopWorker_)) {
+      return false;
+    }
     std::unique_lock<std::mutex> lk(mSampler_);
+    applyPendingUpdates();
 
     float sum;
     int size = storage_.safeSize(&sum);
     assert(size >= batchsize);
     // storage_ [0, size) remains static in the subsequent section
 
+    // sum of the whole buffer, used for importance weights
+    float totalSum = sum;
+    int bucket = -1;
+    auto bucketSum = storage_.bucketSums();
+    if (bucketSum.size() > 0) {
+      std::discrete_distribution<int> bucketDist(bucketSum.begin(), bucketSum.end());
+      bucket = bucketDist(rng_);
+      sum = bucketSum[bucket];
+    }
+    // the sampler below tolerates a small mismatch between sum & accSum
+    float slack = bucket < 0 ? 0.1f : std::min(0.1f, 1e-3f * sum);
+
     float segment = sum / batchsize;
     std::uniform_real_distribution<float> dist(0.0, segment);
 
-    std::vector<DataType> samples;
+    std::vector<DataType>& samples = *outSamples;
+    samples.clear();
     auto weights = torch::zeros({batchsize}, torch::kFloat32);
     auto weightAcc = weights.accessor<float, 1>();
-    std::vector<int> ids(batchsize);
+    std::vector<int64_t>& ids = *outIds;
+    ids.resize(batchsize);
 
     double accSum = 0;
     int nextIdx = 0;
     float w = 0;
-    int id = 0;
+    int64_t id = 0;
     for (int i = 0; i < batchsize; i++) {
       float rand = dist(rng_) + i * segment;
-      rand = std::min(sum - (float)0.1, rand);
+      rand = std::min(sum - slack, rand);
 
       while (nextIdx <= size) {
         if (accSum > 0 && accSum >= rand) {
           assert(nextIdx >= 1);
-          DataType element = storage_.getElementAndMark(nextIdx - 1);
+          DataType element = storage_.get(nextIdx - 1);
           samples.push_back(element);
           weightAcc[i] = w;
           ids[i] = id;
@@ -338,29 +1239,27 @@ class PrioritizedReplay {
         }
 
         w = storage_.getWeight(nextIdx, &id);
+        if (bucket >= 0 && storage_.bucketOf(storage_.getLength(nextIdx)) != bucket) {
+          w = 0;
+        }
         accSum += w;
         ++nextIdx;
       }
     }
     assert((int)samples.size() == batchsize);
 
-    // pop storage if full
-    size = storage_.size();
+    // evict if full
+    size = storage_.safeSize(nullptr);
     if (size > capacity_) {
-      storage_.blockPop(size - capacity_);
+      storage_.evict(size - capacity_, rng_);
     }
 
     // safe to unlock, because <samples> contains copys
     lk.unlock();
 
-    weights = weights / sum;
-    weights = torch::pow(size * weights, -beta_);
-    weights /= weights.max();
-    if (device != "cpu") {
-      weights = weights.to(torch::Device(device));
-    }
-    auto batch = makeBatch(samples, device);
-    return std::make_tuple(batch, weights, ids);
+    weights = weights / totalSum;
+    *outWeights = torch::pow(size * weights, -beta_);
+    return true;
   }
 
   const float alpha_;
@@ -370,11 +1269,45 @@ class PrioritizedReplay {
 
   ConcurrentQueue<DataType> storage_;
   std::atomic<int> numAdd_;
+  // slots are only allocated when used, ready batches + in flight + the
+  // one held by the learner
+  StagingArena staging_{16};
+  std::unique_ptr<RateLimiter> rateLimiter_;
+  std::thread saveThread_;
 
-  // make sure that sample & update does not overlap
+  // serializes sample_, which is the only place that touches priorities
   std::mutex mSampler_;
-  std::vector<int> sampledIds_;
-  std::queue<std::future<SampleWeightIds>> futures_;
+  // one actor spills at a time, see spill_
+  std::mutex mSpill_;
+
+  // see waitSize
+  std::mutex mSizeWait_;
+  std::condition_variable cvSizeWait_;
+  std::atomic<int> numSizeWaiter_{0};
+  bool terminated_ = false;
+  std::vector<int64_t> sampledIds_;
+
+  // priority updates waiting for the next sample_
+  std::mutex mPending_;
+  std::vector<std::vector<int64_t>> pendingIds_;
+  std::vector<torch::Tensor> pendingWeights_;
+
+  // sampler workers, see configureSampler
+  int numWorker_ = 1;
+  int depth_ = 0;
+  std::vector<int> cpus_;
+  int workerBatchsize_ = 0;
+  std::string workerDevice_;
+  std::vector<std::string> workerKeys_;
+  std::vector<std::thread> workers_;
+  std::mutex mReady_;
+  std::condition_variable cvReady_;
+  std::deque<SampleWeightIds> ready_;
+  int numInFlight_ = 0;
+  std::atomic_bool stopWorker_{false};
+  int64_t numSample_ = 0;
+  int64_t numStarved_ = 0;
+  double starvedSec_ = 0;
 
   std::mt19937 rng_;
 };
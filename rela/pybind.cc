@@ -8,9 +8,11 @@
 #include <torch/extension.h>
 
 #include "rela/batch_runner.h"
+#include "rela/composite_replay.h"
 #include "rela/context.h"
 #include "rela/prioritized_replay.h"
 #include "rela/thread_loop.h"
+#include "rela/trace.h"
 #include "rela/transition.h"
 
 namespace py = pybind11;
@@ -24,7 +26,16 @@ PYBIND11_MODULE(rela, m) {
       .def_readwrite("reward", &RNNTransition::reward)
       .def_readwrite("terminal", &RNNTransition::terminal)
       .def_readwrite("bootstrap", &RNNTransition::bootstrap)
-      .def_readwrite("seq_len", &RNNTransition::seqLen);
+      .def_readwrite("seq_len", &RNNTransition::seqLen)
+      .def_readwrite("episode_obs", &RNNTransition::episodeObs)
+      .def_readwrite("zero_h0", &RNNTransition::zeroH0)
+      .def_property_readonly(
+          "max_seq_len", [](const RNNTransition& t) { return t.reward.size(0); });
+
+  py::enum_<EvictionPolicy>(m, "EvictionPolicy")
+      .value("FIFO", EvictionPolicy::kFifo)
+      .value("LOWEST_PRIORITY", EvictionPolicy::kLowestPriority)
+      .value("RESERVOIR", EvictionPolicy::kReservoir);
 
   py::class_<RNNPrioritizedReplay, std::shared_ptr<RNNPrioritizedReplay>>(
       m, "RNNPrioritizedReplay")
@@ -34,13 +45,65 @@ PYBIND11_MODULE(rela, m) {
            float,  // alpha, priority exponent
            float,  // beta, importance sampling exponent
            int>())
+      .def(py::init<
+           int,    // capacity,
+           int,    // seed,
+           float,  // alpha, priority exponent
+           float,  // beta, importance sampling exponent
+           int,    // prefetch
+           EvictionPolicy>())
       .def("clear", &RNNPrioritizedReplay::clear)
       .def("terminate", &RNNPrioritizedReplay::terminate)
       .def("size", &RNNPrioritizedReplay::size)
       .def("num_add", &RNNPrioritizedReplay::numAdd)
-      .def("sample", &RNNPrioritizedReplay::sample)
+      .def(
+          "sample",
+          &RNNPrioritizedReplay::sample,
+          py::arg("batchsize"),
+          py::arg("device"),
+          py::arg("keys") = std::vector<std::string>(),
+          py::call_guard<py::gil_scoped_release>())
       .def("update_priority", &RNNPrioritizedReplay::updatePriority)
-      .def("get", &RNNPrioritizedReplay::get);
+      .def("get", &RNNPrioritizedReplay::get)
+      .def("set_length_buckets", &RNNPrioritizedReplay::setLengthBuckets)
+      .def("configure_sampler", &RNNPrioritizedReplay::configureSampler)
+      .def("sampler_stats", &RNNPrioritizedReplay::samplerStats)
+      .def("set_rate_limit", &RNNPrioritizedReplay::setRateLimit)
+      .def("suspend_insert_limit", &RNNPrioritizedReplay::suspendInsertLimit)
+      .def("rate_limit_stats", &RNNPrioritizedReplay::rateLimitStats)
+      .def("save", &RNNPrioritizedReplay::save)
+      .def("wait_save", &RNNPrioritizedReplay::waitSave)
+      .def("load", &RNNPrioritizedReplay::load)
+      .def("enable_disk_tier", &RNNPrioritizedReplay::enableDiskTier)
+      .def("disk_tier_stats", &RNNPrioritizedReplay::diskTierStats);
+
+  py::class_<RNNCompositeReplay, std::shared_ptr<RNNCompositeReplay>>(
+      m, "RNNCompositeReplay")
+      .def(py::init<
+           int,     // seed
+           float,   // alpha, priority exponent
+           float>())  // beta, importance sampling exponent
+      .def(
+          "add_buffer",
+          &RNNCompositeReplay::addBuffer,
+          py::arg("name"),
+          py::arg("capacity"),
+          py::arg("eviction") = EvictionPolicy::kFifo)
+      .def("buffer", &RNNCompositeReplay::buffer)
+      .def("set_mix", &RNNCompositeReplay::setMix)
+      .def("batch_counts", &RNNCompositeReplay::batchCounts)
+      .def("terminate", &RNNCompositeReplay::terminate)
+      .def("size", &RNNCompositeReplay::size)
+      .def("num_add", &RNNCompositeReplay::numAdd)
+      .def(
+          "sample",
+          &RNNCompositeReplay::sample,
+          py::arg("batchsize"),
+          py::arg("device"),
+          py::arg("keys") = std::vector<std::string>(),
+          py::call_guard<py::gil_scoped_release>())
+      .def("update_priority", &RNNCompositeReplay::updatePriority)
+      .def("stats", &RNNCompositeReplay::stats);
 
   py::class_<TensorDictReplay, std::shared_ptr<TensorDictReplay>>(m, "TensorDictReplay")
       .def(py::init<
@@ -51,7 +114,13 @@ PYBIND11_MODULE(rela, m) {
            int>())
       .def("size", &TensorDictReplay::size)
       .def("num_add", &TensorDictReplay::numAdd)
-      .def("sample", &TensorDictReplay::sample)
+      .def(
+          "sample",
+          &TensorDictReplay::sample,
+          py::arg("batchsize"),
+          py::arg("device"),
+          py::arg("keys") = std::vector<std::string>(),
+          py::call_guard<py::gil_scoped_release>())
       .def("update_priority", &TensorDictReplay::updatePriority)
       .def("get", &TensorDictReplay::get);
 
@@ -61,10 +130,12 @@ PYBIND11_MODULE(rela, m) {
       .def(py::init<>())
       .def("push_thread_loop", &Context::pushThreadLoop, py::keep_alive<1, 2>())
       .def("start", &Context::start)
-      .def("pause", &Context::pause)
+      .def("pause", &Context::pause, py::call_guard<py::gil_scoped_release>())
       .def("resume", &Context::resume)
       .def("join", &Context::join)
-      .def("terminated", &Context::terminated);
+      .def("terminated", &Context::terminated)
+      .def("last_pause_latency", &Context::lastPauseLatency)
+      .def("num_pause", &Context::numPause);
 
   py::class_<BatchRunner, std::shared_ptr<BatchRunner>>(m, "BatchRunner")
       .def(py::init<
@@ -77,5 +148,12 @@ PYBIND11_MODULE(rela, m) {
       .def("start", &BatchRunner::start)
       .def("stop", &BatchRunner::stop)
       .def("update_model", &BatchRunner::updateModel)
-      .def("set_log_freq", &BatchRunner::setLogFreq);
+      .def("set_log_freq", &BatchRunner::setLogFreq)
+      .def("batch_count", &BatchRunner::batchCount)
+      .def("stats", &BatchRunner::stats)
+      .def("reset_stats", &BatchRunner::resetStats);
+
+  m.def("trace_start", &trace::start);
+  m.def("trace_stop", &trace::stop);
+  m.def("trace_dump", &trace::dump, py::arg("path"), py::arg("pid") = 0);
 }
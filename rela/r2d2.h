@@ -7,6 +7,7 @@
 #pragma once
 
 #include "rela/tensor_dict.h"
+#include "rela/tensor_record.h"
 #include "rela/transition.h"
 
 namespace rela {
@@ -17,8 +18,6 @@ class R2D2Buffer {
       : multiStep_(multiStep)
       , maxSeqLen_(seqLen)
       , gamma_(gamma)
-      , obs_(seqLen)
-      , action_(seqLen)
       , reward_(seqLen)
       , terminal_(seqLen)
       , bootstrap_(seqLen)
@@ -27,21 +26,35 @@ class R2D2Buffer {
       , callOrder_(0) {
   }
 
-  void init(const TensorDict& h0) {
-    h0_ = h0;
+  // episodeObs holds per episode constants (e.g. eps), they are stored once
+  // per transition and broadcast over time by toDict/makeBatch
+  void init(const TensorDict& h0, const TensorDict& episodeObs = {}) {
+    zeroH0_ = h0.size() > 0;
+    for (auto& kv : h0) {
+      zeroH0_ = zeroH0_ && !kv.second.any().item<bool>();
+    }
+    if (zeroH0_) {
+      // share one zero state between all transitions of this buffer
+      if (!tensor_dict::sameShape(zeroH0Cache_, h0)) {
+        zeroH0Cache_ = h0;
+      }
+      h0_ = zeroH0Cache_;
+    } else {
+      h0_ = h0;
+    }
+    episodeObs_ = episodeObs;
   }
 
   int len() const {
     return seqLen_;
   }
 
-  TensorDict& obsBack() {
-    if (callOrder_ == 0) {
-      assert(seqLen_ > 0);
-      return obs_[seqLen_ - 1];
-    } else {
-      return obs_[seqLen_];
-    }
+  // add a field to the most recent obs, e.g. a target computed after acting
+  void addObsBack(const std::string& key, const torch::Tensor& t) {
+    int step = callOrder_ == 0 ? seqLen_ - 1 : seqLen_;
+    assert(step >= 0);
+    write(obs_, key, step, t);
+    ++numObsKey_;
   }
 
   void pushObs(const TensorDict& obs) {
@@ -49,13 +62,41 @@ class R2D2Buffer {
     ++callOrder_;
 
     assert(seqLen_ < maxSeqLen_);
-    obs_[seqLen_] = obs;
+    checkObsSchema();
+    for (auto& kv : obs) {
+      write(obs_, kv.first, seqLen_, kv.second);
+    }
+    numObsKey_ = obs.size();
+  }
+
+  // only the given fields of obs, e.g. an act input without eps & hidden
+  void pushObs(const TensorRecord& obs, const std::vector<int>& fields) {
+    assert(callOrder_ == 0);
+    ++callOrder_;
+
+    assert(seqLen_ < maxSeqLen_);
+    checkObsSchema();
+    for (int i : fields) {
+      write(obs_, obs.schema()->key(i), seqLen_, obs[i]);
+    }
+    numObsKey_ = fields.size();
   }
 
   void pushAction(const TensorDict& action) {
     assert(callOrder_ == 1);
     ++callOrder_;
-    action_[seqLen_] = action;
+    for (auto& kv : action) {
+      write(action_, kv.first, seqLen_, kv.second);
+    }
+  }
+
+  // only the given fields of action, e.g. an act reply without the hidden
+  void pushAction(const TensorRecord& action, const std::vector<int>& fields) {
+    assert(callOrder_ == 1);
+    ++callOrder_;
+    for (int i : fields) {
+      write(action_, action.schema()->key(i), seqLen_, action[i]);
+    }
   }
 
   void pushReward(float r) {
@@ -99,36 +140,94 @@ class R2D2Buffer {
     }
 
     // padding
+    checkObsSchema();
+    for (auto& kv : obs_) {
+      kv.second.narrow(0, seqLen_, maxSeqLen_ - seqLen_).fill_(0);
+    }
+    for (auto& kv : action_) {
+      kv.second.narrow(0, seqLen_, maxSeqLen_ - seqLen_).fill_(0);
+    }
     for (int i = seqLen_; i < maxSeqLen_; ++i) {
-      obs_[i] = tensor_dict::zerosLike(obs_[seqLen_ - 1]);
-      action_[i] = tensor_dict::zerosLike(action_[seqLen_ - 1]);
       reward_[i] = 0.f;
       terminal_[i] = 1.0f;
       accReward_[i] = 0.0f;
     }
 
+    // padded_ views the storage and stays valid until the next pushObs, it
+    // is only meant to be copied into a batcher, e.g. for compute_priority
+    padded_.obs = obs_;
+    padded_.action = action_;
+    padded_.reward = torch::tensor(accReward_);
+    padded_.terminal = torch::tensor(terminal_);
+    padded_.bootstrap = torch::tensor(bootstrap_);
+    padded_.seqLen = torch::tensor(float(seqLen_));
+    padded_.h0 = h0_;
+    padded_.zeroH0 = zeroH0_;
+    padded_.episodeObs = episodeObs_;
+
+    // only keep the valid steps, makeBatch pads to the longest in a batch
     RNNTransition transition;
-    transition.obs = tensor_dict::stack(obs_, 0);
-    transition.action = tensor_dict::stack(action_, 0);
-    transition.reward = torch::tensor(accReward_);
-    transition.terminal = torch::tensor(terminal_);
-    transition.bootstrap = torch::tensor(bootstrap_);
-    transition.seqLen = torch::tensor(float(seqLen_));
+    transition.obs = prefix(padded_.obs, seqLen_);
+    transition.action = prefix(padded_.action, seqLen_);
+    transition.reward = padded_.reward.narrow(0, 0, seqLen_).clone();
+    transition.terminal = padded_.terminal.narrow(0, 0, seqLen_).clone();
+    transition.bootstrap = padded_.bootstrap.narrow(0, 0, seqLen_).clone();
+    transition.seqLen = padded_.seqLen;
     transition.h0 = h0_;
+    transition.zeroH0 = zeroH0_;
+    transition.episodeObs = episodeObs_;
 
     seqLen_ = 0;
     callOrder_ = 0;
     return transition;
   }
 
+  // the last popped transition padded to maxSeqLen, see popTransition
+  const RNNTransition& paddedTransition() const {
+    return padded_;
+  }
+
  private:
+  // write t into step of the [maxSeqLen, ...] storage of key, the storage is
+  // allocated the first time a key is seen
+  void write(TensorDict& storage, const std::string& key, int step, const torch::Tensor& t) {
+    auto it = storage.find(key);
+    if (it == storage.end()) {
+      auto sizes = t.sizes().vec();
+      sizes.insert(sizes.begin(), maxSeqLen_);
+      it = storage.emplace(key, torch::zeros(sizes, t.options())).first;
+    }
+    it->second[step].copy_(t);
+  }
+
+  static TensorDict prefix(const TensorDict& storage, int len) {
+    TensorDict out;
+    for (auto& kv : storage) {
+      out.insert({kv.first, kv.second.narrow(0, 0, len).clone()});
+    }
+    return out;
+  }
+
+  // every step has to write the same set of obs keys
+  void checkObsSchema() const {
+    if (seqLen_ > 0) {
+      assert(numObsKey_ == obs_.size());
+    }
+  }
+
   const int multiStep_;
   const int maxSeqLen_;
   const float gamma_;
 
   TensorDict h0_;
-  std::vector<TensorDict> obs_;
-  std::vector<TensorDict> action_;
+  TensorDict zeroH0Cache_;
+  bool zeroH0_ = false;
+  TensorDict episodeObs_;
+  // [maxSeqLen, ...] per key, written in place
+  TensorDict obs_;
+  TensorDict action_;
+  size_t numObsKey_ = 0;
+  RNNTransition padded_;
   std::vector<float> reward_;
   std::vector<float> terminal_;
 
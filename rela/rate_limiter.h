@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace rela {
+
+// keeps the number of sampled elements close to samplesPerInsert times the
+// number of inserted ones. with
+//   diff = numInsert * samplesPerInsert - numSample
+// inserts block while diff would go above offset + errorBuffer and samples
+// block while diff would go below offset - errorBuffer, where
+// offset = minSizeToSample * samplesPerInsert. inserts are never blocked
+// and samples always blocked until minSizeToSample elements are inserted.
+// errorBuffer has to cover a whole sample batch and insert block, i.e.
+// 2 * errorBuffer >= max(batchsize, samplesPerInsert * blockSize)
+class RateLimiter {
+ public:
+  RateLimiter(float samplesPerInsert, int minSizeToSample, float errorBuffer)
+      : samplesPerInsert_(samplesPerInsert)
+      , minSizeToSample_(minSizeToSample)
+      , minDiff_(minSizeToSample * samplesPerInsert - errorBuffer)
+      , maxDiff_(minSizeToSample * samplesPerInsert + errorBuffer) {
+    assert(samplesPerInsert > 0);
+    assert(errorBuffer >= 0);
+  }
+
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  // block until n elements can be inserted, false if terminated. never
+  // blocks while the insert limit is suspended
+  bool awaitInsert(int n) {
+    std::unique_lock<std::mutex> lk(m_);
+    if (!canInsert(n)) {
+      ++numInsertBlocked_;
+      insertBlockedSec_ += wait(lk, [&] { return canInsert(n); });
+    }
+    if (terminated_) {
+      return false;
+    }
+    numInsert_ += n;
+    lk.unlock();
+    cv_.notify_all();
+    return true;
+  }
+
+  // block until n elements can be sampled, false if terminated or
+  // interrupted while *cancel is set
+  bool awaitSample(int n, const std::atomic_bool* cancel = nullptr) {
+    std::unique_lock<std::mutex> lk(m_);
+    if (!canSample(n)) {
+      ++numSampleBlocked_;
+      sampleBlockedSec_ +=
+          wait(lk, [&] { return canSample(n) || (cancel != nullptr && *cancel); });
+      if (!canSample(n)) {
+        return false;
+      }
+    }
+    if (terminated_) {
+      return false;
+    }
+    numSample_ += n;
+    lk.unlock();
+    cv_.notify_all();
+    return true;
+  }
+
+  // wake up blocked threads so that they re-check their cancel flag
+  void interrupt() {
+    {
+      std::lock_guard<std::mutex> lk(m_);
+    }
+    cv_.notify_all();
+  }
+
+  // count n elements loaded from a snapshot as inserted, without blocking.
+  // they were already sampled at the target ratio by the run that saved
+  // them, so the ones beyond minSizeToSample also count as sampled and the
+  // limiter starts out balanced
+  void restore(int64_t n) {
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      int64_t before = std::max<int64_t>(0, numInsert_ - minSizeToSample_);
+      numInsert_ += n;
+      int64_t after = std::max<int64_t>(0, numInsert_ - minSizeToSample_);
+      numSample_ += std::llround((after - before) * (double)samplesPerInsert_);
+    }
+    cv_.notify_all();
+  }
+
+  // let inserts through regardless of the sample count, e.g. while the
+  // actors are paused: an actor blocked in awaitInsert would never reach its
+  // pause point while the learner waits for it instead of sampling. blocked
+  // inserts are released, the extra elements are paid back by blocking
+  // later inserts once the limit is restored
+  void suspendInsertLimit(bool suspend) {
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      insertLimitSuspended_ = suspend;
+    }
+    cv_.notify_all();
+  }
+
+  void terminate() {
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      terminated_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  std::unordered_map<std::string, float> stats() {
+    std::lock_guard<std::mutex> lk(m_);
+    return {
+        {"num_insert", (float)numInsert_},
+        {"num_sample", (float)numSample_},
+        {"samples_per_insert",
+         numInsert_ > minSizeToSample_
+             ? (float)numSample_ / (numInsert_ - minSizeToSample_)
+             : 0.0f},
+        {"num_insert_blocked", (float)numInsertBlocked_},
+        {"insert_blocked_sec", (float)insertBlockedSec_},
+        {"num_sample_blocked", (float)numSampleBlocked_},
+        {"sample_blocked_sec", (float)sampleBlockedSec_},
+    };
+  }
+
+ private:
+  // must hold m_
+  bool canInsert(int n) const {
+    if (insertLimitSuspended_ || numInsert_ + n <= minSizeToSample_) {
+      return true;
+    }
+    return diff() + n * samplesPerInsert_ <= maxDiff_;
+  }
+
+  // must hold m_
+  bool canSample(int n) const {
+    if (numInsert_ < minSizeToSample_) {
+      return false;
+    }
+    return diff() - n >= minDiff_;
+  }
+
+  double diff() const {
+    return numInsert_ * (double)samplesPerInsert_ - numSample_;
+  }
+
+  template <typename Pred>
+  double wait(std::unique_lock<std::mutex>& lk, Pred pred) {
+    auto begin = std::chrono::steady_clock::now();
+    cv_.wait(lk, [&] { return terminated_ || pred(); });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return elapsed.count();
+  }
+
+  const float samplesPerInsert_;
+  const int minSizeToSample_;
+  const double minDiff_;
+  const double maxDiff_;
+
+  std::mutex m_;
+  std::condition_variable cv_;
+  bool terminated_ = false;
+  bool insertLimitSuspended_ = false;
+
+  int64_t numInsert_ = 0;
+  int64_t numSample_ = 0;
+  int64_t numInsertBlocked_ = 0;
+  int64_t numSampleBlocked_ = 0;
+  double insertBlockedSec_ = 0;
+  double sampleBlockedSec_ = 0;
+};
+
+}  // namespace rela
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "rela/tensor_dict.h"
+#include "rela/transition.h"
+
+// streaming binary format used to save & load replay buffers.
+// a tensor is stored as [dtype:int8][dim:int8][sizes:int64 x dim][raw data],
+// a string as [len:uint32][chars] and a TensorDict as [num:uint32] followed
+// by (key, tensor) pairs
+namespace rela {
+namespace serialize {
+
+class Writer {
+ public:
+  Writer(const std::string& path)
+      : file_(path, std::ios::binary)
+      , os_(&file_) {
+    // reported by good()
+    if (!file_) {
+      std::cout << "Error: cannot open " << path << " for writing" << std::endl;
+    }
+  }
+
+  Writer(std::ostream& os)
+      : os_(&os) {
+  }
+
+  template <typename T>
+  void write(const T& v) {
+    static_assert(std::is_trivially_copyable<T>::value, "");
+    os_->write(reinterpret_cast<const char*>(&v), sizeof(T));
+  }
+
+  void write(const std::string& s) {
+    write<uint32_t>(s.size());
+    os_->write(s.data(), s.size());
+  }
+
+  void write(const torch::Tensor& t) {
+    auto c = t.contiguous().cpu();
+    write<int8_t>((int8_t)c.scalar_type());
+    write<int8_t>((int8_t)c.dim());
+    for (auto s : c.sizes()) {
+      write<int64_t>(s);
+    }
+    os_->write(reinterpret_cast<const char*>(c.data_ptr()), c.nbytes());
+  }
+
+  void write(const TensorDict& d) {
+    write<uint32_t>(d.size());
+    for (auto& kv : d) {
+      write(kv.first);
+      write(kv.second);
+    }
+  }
+
+  bool good() const {
+    return os_->good();
+  }
+
+  // position of the next write, a value can be patched there with writeAt
+  std::streampos tell() {
+    return os_->tellp();
+  }
+
+  template <typename T>
+  void writeAt(std::streampos pos, const T& v) {
+    auto end = os_->tellp();
+    os_->seekp(pos);
+    write(v);
+    os_->seekp(end);
+  }
+
+  // whether everything written so far has reached the file
+  bool flush() {
+    os_->flush();
+    return os_->good();
+  }
+
+ private:
+  std::ofstream file_;
+  std::ostream* os_;
+};
+
+// reads from a read-only mmap of the whole file or from a given memory
+// range, tensors are copied out. a truncated or corrupt input throws
+// std::runtime_error instead of reading past the end
+class Reader {
+ public:
+  Reader(const char* data, size_t size)
+      : data_(const_cast<char*>(data))
+      , size_(size)
+      , ownData_(false) {
+  }
+
+  Reader(const std::string& path)
+      : ownData_(true) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      int err = errno;
+      close(fd);
+      throw std::runtime_error("cannot stat " + path + ": " + std::strerror(err));
+    }
+    size_ = st.st_size;
+    // mmap rejects empty ranges, the first read of an empty file throws
+    if (size_ == 0) {
+      close(fd);
+      return;
+    }
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    int err = errno;
+    close(fd);
+    if (data == MAP_FAILED) {
+      throw std::runtime_error("cannot map " + path + ": " + std::strerror(err));
+    }
+    data_ = (char*)data;
+    madvise(data_, size_, MADV_SEQUENTIAL);
+  }
+
+  Reader(const Reader&) = delete;
+  Reader& operator=(const Reader&) = delete;
+
+  ~Reader() {
+    if (ownData_ && data_ != nullptr) {
+      munmap(data_, size_);
+    }
+  }
+
+  template <typename T>
+  T read() {
+    static_assert(std::is_trivially_copyable<T>::value, "");
+    T v;
+    std::memcpy(&v, take(sizeof(T)), sizeof(T));
+    return v;
+  }
+
+  std::string readString() {
+    auto len = read<uint32_t>();
+    return std::string(take(len), len);
+  }
+
+  torch::Tensor readTensor() {
+    auto dtype = (torch::Dtype)read<int8_t>();
+    if (!validDtype(dtype)) {
+      throw std::runtime_error("corrupt tensor, unknown dtype " + std::to_string((int)dtype));
+    }
+    int dim = read<int8_t>();
+    if (dim < 0 || dim > kMaxDim) {
+      throw std::runtime_error("corrupt tensor, bad dim " + std::to_string(dim));
+    }
+    // check the data size against what is left before allocating
+    std::vector<int64_t> sizes(dim);
+    size_t nbytes = c10::elementSize(dtype);
+    for (int i = 0; i < dim; ++i) {
+      sizes[i] = read<int64_t>();
+      if (sizes[i] < 0) {
+        throw std::runtime_error("corrupt tensor, negative size");
+      }
+      if (sizes[i] > 0 && nbytes > (size_ - pos_) / sizes[i]) {
+        throw std::runtime_error("truncated tensor");
+      }
+      nbytes *= sizes[i];
+    }
+    const char* src = take(nbytes);
+    auto t = torch::empty(sizes, torch::TensorOptions().dtype(dtype));
+    std::memcpy(t.data_ptr(), src, nbytes);
+    return t;
+  }
+
+  TensorDict readTensorDict() {
+    TensorDict d;
+    auto num = read<uint32_t>();
+    for (uint32_t i = 0; i < num; ++i) {
+      auto key = readString();
+      d[key] = readTensor();
+    }
+    return d;
+  }
+
+  // zero h0 shared by the transitions read so far, see R2D2Buffer::init
+  TensorDict& zeroH0() {
+    return zeroH0_;
+  }
+
+ private:
+  // the dtypes written by Writer, see (int8_t)scalar_type()
+  static bool validDtype(torch::Dtype dtype) {
+    switch (dtype) {
+      case torch::kUInt8:
+      case torch::kInt8:
+      case torch::kInt16:
+      case torch::kInt32:
+      case torch::kInt64:
+      case torch::kFloat16:
+      case torch::kFloat32:
+      case torch::kFloat64:
+      case torch::kBool:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  const char* take(size_t n) {
+    if (n > size_ - pos_) {
+      throw std::runtime_error(
+          "truncated input, need " + std::to_string(n) + " bytes at offset " +
+          std::to_string(pos_) + " of " + std::to_string(size_));
+    }
+    const char* p = data_ + pos_;
+    pos_ += n;
+    return p;
+  }
+
+  static constexpr int kMaxDim = 16;
+
+  char* data_ = nullptr;
+  size_t size_ = 0;
+  size_t pos_ = 0;
+  const bool ownData_;
+  TensorDict zeroH0_;
+};
+
+inline void write(Writer& w, const TensorDict& d) {
+  w.write(d);
+}
+
+inline void read(Reader& r, TensorDict& d) {
+  d = r.readTensorDict();
+}
+
+inline void write(Writer& w, const RNNTransition& t) {
+  w.write(t.obs);
+  w.write(t.h0);
+  w.write(t.action);
+  w.write(t.reward);
+  w.write(t.terminal);
+  w.write(t.bootstrap);
+  w.write(t.seqLen);
+  w.write(t.episodeObs);
+  w.write<int8_t>(t.zeroH0);
+}
+
+inline void read(Reader& r, RNNTransition& t) {
+  t.obs = r.readTensorDict();
+  t.h0 = r.readTensorDict();
+  t.action = r.readTensorDict();
+  t.reward = r.readTensor();
+  t.terminal = r.readTensor();
+  t.bootstrap = r.readTensor();
+  t.seqLen = r.readTensor();
+  t.episodeObs = r.readTensorDict();
+  t.zeroH0 = r.read<int8_t>();
+  if (t.zeroH0) {
+    if (tensor_dict::sameShape(r.zeroH0(), t.h0)) {
+      t.h0 = r.zeroH0();
+    } else {
+      r.zeroH0() = t.h0;
+    }
+  }
+}
+
+}  // namespace serialize
+}  // namespace rela
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <c10/core/CPUAllocator.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <torch/extension.h>
+
+namespace rela {
+
+// pool allocator for the many tiny cpu tensors created by actor threads
+// (observations, eps, actions, rewards). once enabled it is installed as
+// torch's cpu allocator, but only threads inside a SmallTensorPoolGuard
+// allocate from a pool, everything else goes to the default allocator.
+// every block, pooled or not, has a header in front of the data, so that
+// raw_allocate/raw_deallocate work on the pointer alone.
+// blocks are kept in per thread free lists by power of 2 size class and
+// can be freed from any thread, they go back to the pool they came from.
+//
+// the state is in function local statics, so every python extension that
+// includes this header (hidden visibility, loaded RTLD_LOCAL) has its own
+// copy. enable() & stats() only see the guards of the module they are
+// called from, which is hanalearn for the actor threads
+class SmallTensorPool {
+ public:
+  static constexpr int kNumClass = 9;  // 64B .. 16KB
+  static constexpr size_t kMinBytes = 64;
+  static constexpr size_t kMaxBytes = kMinBytes << (kNumClass - 1);
+  // more free blocks than this per class are returned to the system
+  static constexpr size_t kMaxFree = 4096;
+
+  // must be called before any guard is created to have an effect
+  static void enable() {
+    static std::once_flag flag;
+    std::call_once(flag, [] {
+      allocator().base_ = c10::GetCPUAllocator();
+      c10::SetCPUAllocator(&allocator(), /*priority=*/1);
+      enabled() = true;
+    });
+  }
+
+  static bool isEnabled() {
+    return enabled();
+  }
+
+  // num_pooled: allocations served by a pool, num_reuse: of those, the ones
+  // served from a free list without calling malloc, num_fallback: too big
+  // allocations made inside a guard
+  static std::unordered_map<std::string, float> stats() {
+    auto& c = counters();
+    return {
+        {"enabled", (float)enabled()},
+        {"num_pooled", (float)c.numPooled.load()},
+        {"num_reuse", (float)c.numReuse.load()},
+        {"num_fallback", (float)c.numFallback.load()},
+        {"num_release", (float)c.numRelease.load()},
+    };
+  }
+
+ private:
+  friend class SmallTensorPoolGuard;
+
+  struct Pool;
+
+  // header in front of every block, data starts kHeader bytes later to keep
+  // torch's 64 byte alignment. pool is null for blocks of the default
+  // allocator
+  struct Block {
+    Pool* pool;
+    int sizeClass;
+  };
+  static constexpr size_t kHeader = 64;
+
+  struct Pool {
+    std::mutex m;
+    std::vector<Block*> free[kNumClass];
+  };
+
+  struct Counters {
+    std::atomic<int64_t> numPooled{0};
+    std::atomic<int64_t> numReuse{0};
+    std::atomic<int64_t> numFallback{0};
+    std::atomic<int64_t> numRelease{0};
+  };
+
+  class Allocator : public c10::Allocator {
+   public:
+    c10::DataPtr allocate(size_t nbytes) const override {
+      Pool* pool = currentPool();
+      if (pool == nullptr || nbytes > kMaxBytes) {
+        if (pool != nullptr) {
+          ++counters().numFallback;
+        }
+        auto block = static_cast<Block*>(base_->raw_allocate(kHeader + nbytes));
+        block->pool = nullptr;
+        block->sizeClass = -1;
+        return toDataPtr(block);
+      }
+
+      int sizeClass = 0;
+      while ((kMinBytes << sizeClass) < nbytes) {
+        ++sizeClass;
+      }
+      ++counters().numPooled;
+      Block* block = nullptr;
+      {
+        std::lock_guard<std::mutex> lk(pool->m);
+        auto& freeList = pool->free[sizeClass];
+        if (!freeList.empty()) {
+          block = freeList.back();
+          freeList.pop_back();
+        }
+      }
+      if (block != nullptr) {
+        ++counters().numReuse;
+      } else {
+        void* mem = nullptr;
+        int rc = posix_memalign(&mem, kHeader, kHeader + (kMinBytes << sizeClass));
+        assert(rc == 0);
+        (void)rc;
+        block = static_cast<Block*>(mem);
+        block->pool = pool;
+        block->sizeClass = sizeClass;
+      }
+      return toDataPtr(block);
+    }
+
+    c10::DeleterFnPtr raw_deleter() const override {
+      return &release;
+    }
+
+    c10::Allocator* base_ = nullptr;
+  };
+
+  // data is the context too, as raw_allocate requires
+  static c10::DataPtr toDataPtr(Block* block) {
+    void* data = reinterpret_cast<char*>(block) + kHeader;
+    return {data, data, &release, c10::Device(c10::DeviceType::CPU)};
+  }
+
+  static void release(void* data) {
+    auto block = reinterpret_cast<Block*>(static_cast<char*>(data) - kHeader);
+    auto pool = block->pool;
+    if (pool == nullptr) {
+      allocator().base_->raw_deallocate(block);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lk(pool->m);
+      auto& freeList = pool->free[block->sizeClass];
+      if (freeList.size() < kMaxFree) {
+        freeList.push_back(block);
+        return;
+      }
+    }
+    ++counters().numRelease;
+    free(block);
+  }
+
+  static Allocator& allocator() {
+    static Allocator instance;
+    return instance;
+  }
+
+  static bool& enabled() {
+    static bool flag = false;
+    return flag;
+  }
+
+  static Counters& counters() {
+    static Counters instance;
+    return instance;
+  }
+
+  static Pool*& currentPool() {
+    static thread_local Pool* pool = nullptr;
+    return pool;
+  }
+
+  // pools are never destroyed since blocks may outlive their thread, a
+  // finished thread's pool is handed to the next one instead
+  static Pool* acquirePool() {
+    std::lock_guard<std::mutex> lk(registryMutex());
+    auto& idle = idlePools();
+    if (!idle.empty()) {
+      auto pool = idle.back();
+      idle.pop_back();
+      return pool;
+    }
+    return new Pool();
+  }
+
+  static void releasePool(Pool* pool) {
+    std::lock_guard<std::mutex> lk(registryMutex());
+    idlePools().push_back(pool);
+  }
+
+  static std::mutex& registryMutex() {
+    static std::mutex m;
+    return m;
+  }
+
+  static std::vector<Pool*>& idlePools() {
+    static std::vector<Pool*> pools;
+    return pools;
+  }
+};
+
+// small cpu tensors created by this thread while the guard is alive come
+// from a pool owned by the thread, a no-op unless SmallTensorPool::enable()
+// has been called. guards can be nested
+class SmallTensorPoolGuard {
+ public:
+  SmallTensorPoolGuard() {
+    if (!SmallTensorPool::isEnabled() || SmallTensorPool::currentPool() != nullptr) {
+      return;
+    }
+    pool_ = SmallTensorPool::acquirePool();
+    SmallTensorPool::currentPool() = pool_;
+  }
+
+  SmallTensorPoolGuard(const SmallTensorPoolGuard&) = delete;
+  SmallTensorPoolGuard& operator=(const SmallTensorPoolGuard&) = delete;
+
+  ~SmallTensorPoolGuard() {
+    if (pool_ == nullptr) {
+      return;
+    }
+    SmallTensorPool::currentPool() = nullptr;
+    SmallTensorPool::releasePool(pool_);
+  }
+
+ private:
+  SmallTensorPool::Pool* pool_ = nullptr;
+};
+
+}  // namespace rela
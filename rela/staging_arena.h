@@ -0,0 +1,95 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <torch/extension.h>
+
+namespace rela {
+
+// a ring of reusable host byte buffers for gathering batches. a buffer is
+// handed out by acquire() and becomes free again once every tensor
+// referencing it (e.g. the views of a PackedTensors) is released, which is
+// detected through its use count, so consumers do not have to return it.
+// pinned buffers are page-locked for faster host to device copies
+class StagingArena {
+ public:
+  StagingArena(int numSlot)
+      : hasCuda_(torch::cuda::is_available())
+      , slots_(numSlot) {
+  }
+
+  StagingArena(const StagingArena&) = delete;
+  StagingArena& operator=(const StagingArena&) = delete;
+
+  // a [>= nbytes] uint8 host tensor that nobody else references. if every
+  // slot is still in use a fresh buffer is returned and counted as a miss
+  torch::Tensor acquire(int64_t nbytes, bool pinned) {
+    pinned = pinned && hasCuda_;
+    std::lock_guard<std::mutex> lk(m_);
+    ++numAcquire_;
+    int freeSlot = -1;
+    for (int i = 0; i < (int)slots_.size(); ++i) {
+      auto& slot = slots_[i];
+      if (slot.defined() && !unused(slot)) {
+        continue;
+      }
+      if (slot.defined() && slot.numel() >= nbytes && slot.is_pinned() == pinned) {
+        ++numReuse_;
+        return slot;
+      }
+      freeSlot = i;
+    }
+    if (freeSlot < 0) {
+      ++numMiss_;
+      return allocate(nbytes, pinned);
+    }
+    // leave some room for batches that are a little longer
+    slots_[freeSlot] = allocate(nbytes + nbytes / 4, pinned);
+    ++numAlloc_;
+    return slots_[freeSlot];
+  }
+
+  std::unordered_map<std::string, float> stats() {
+    std::lock_guard<std::mutex> lk(m_);
+    int64_t bytes = 0;
+    for (auto& slot : slots_) {
+      if (slot.defined()) {
+        bytes += slot.numel();
+      }
+    }
+    return {
+        {"num_acquire", (float)numAcquire_},
+        {"num_reuse", (float)numReuse_},
+        {"num_alloc", (float)numAlloc_},
+        {"num_miss", (float)numMiss_},
+        {"bytes", (float)bytes},
+    };
+  }
+
+ private:
+  // nobody but the arena holds the slot or a view of its memory. views made
+  // with narrow, select etc. have their own TensorImpl but share the storage
+  static bool unused(const torch::Tensor& slot) {
+    return slot.use_count() == 1 && slot.storage().use_count() == 1;
+  }
+
+  static torch::Tensor allocate(int64_t nbytes, bool pinned) {
+    return torch::empty(
+        {nbytes}, torch::TensorOptions().dtype(torch::kUInt8).pinned_memory(pinned));
+  }
+
+  // pinned memory needs a cuda device, checked once as it queries the driver
+  const bool hasCuda_;
+  std::mutex m_;
+  std::vector<torch::Tensor> slots_;
+
+  int64_t numAcquire_ = 0;
+  int64_t numReuse_ = 0;
+  int64_t numAlloc_ = 0;
+  int64_t numMiss_ = 0;
+};
+
+}  // namespace rela
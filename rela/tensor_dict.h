@@ -64,6 +64,19 @@ inline void copy(const TensorDict& src, TensorDict& dest, const torch::Tensor& i
   }
 }
 
+inline bool sameShape(const TensorDict& d0, const TensorDict& d1) {
+  if (d0.size() != d1.size()) {
+    return false;
+  }
+  for (auto& kv : d0) {
+    auto it = d1.find(kv.first);
+    if (it == d1.end() || it->second.sizes() != kv.second.sizes()) {
+      return false;
+    }
+  }
+  return true;
+}
+
 inline bool eq(const TensorDict& d0, const TensorDict& d1) {
   if (d0.size() != d1.size()) {
     return false;
@@ -111,6 +124,18 @@ inline TensorDict clone(const TensorDict& input) {
   return output;
 }
 
+// only the entries of input whose key is in keys, missing keys are skipped
+inline TensorDict select(const TensorDict& input, const std::vector<std::string>& keys) {
+  TensorDict output;
+  for (auto& key : keys) {
+    auto it = input.find(key);
+    if (it != input.end()) {
+      output.insert(*it);
+    }
+  }
+  return output;
+}
+
 inline TensorDict zerosLike(const TensorDict& input) {
   TensorDict output;
   for (auto& name2tensor : input) {
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <c10/util/SmallVector.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rela/tensor_dict.h"
+
+namespace rela {
+
+// sorted set of field names. schemas are interned, two records have the
+// same fields iff they point to the same Schema
+class Schema {
+ public:
+  static std::shared_ptr<const Schema> intern(std::vector<std::string> keys) {
+    std::sort(keys.begin(), keys.end());
+    static std::mutex m;
+    static std::map<std::vector<std::string>, std::shared_ptr<const Schema>> registry;
+    std::lock_guard<std::mutex> lk(m);
+    auto it = registry.find(keys);
+    if (it == registry.end()) {
+      it = registry.emplace(keys, std::shared_ptr<const Schema>(new Schema(keys))).first;
+    }
+    return it->second;
+  }
+
+  static std::shared_ptr<const Schema> of(const TensorDict& d) {
+    return intern(tensor_dict::getKeys(d));
+  }
+
+  int size() const {
+    return keys_.size();
+  }
+
+  const std::string& key(int i) const {
+    return keys_[i];
+  }
+
+  const std::vector<std::string>& keys() const {
+    return keys_;
+  }
+
+  // -1 if key is not a field
+  int indexOf(const std::string& key) const {
+    auto it = index_.find(key);
+    return it == index_.end() ? -1 : it->second;
+  }
+
+  // whether d has exactly these fields
+  bool matches(const TensorDict& d) const {
+    if ((int)d.size() != size()) {
+      return false;
+    }
+    for (auto& kv : d) {
+      if (indexOf(kv.first) < 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  Schema(const std::vector<std::string>& keys)
+      : keys_(keys) {
+    for (int i = 0; i < (int)keys_.size(); ++i) {
+      index_[keys_[i]] = i;
+    }
+  }
+
+  const std::vector<std::string> keys_;
+  std::unordered_map<std::string, int> index_;
+};
+
+using SchemaPtr = std::shared_ptr<const Schema>;
+
+// a TensorDict with fields stored by index in schema order. field access is
+// O(1) through the index, names are only looked up when converting from or
+// to a TensorDict, which is what the pybind boundary & models consume
+class TensorRecord {
+ public:
+  TensorRecord() = default;
+
+  explicit TensorRecord(SchemaPtr schema)
+      : schema_(std::move(schema))
+      , fields_(schema_->size()) {
+  }
+
+  TensorRecord(SchemaPtr schema, const std::vector<torch::Tensor>& fields)
+      : schema_(std::move(schema))
+      , fields_(fields.begin(), fields.end()) {
+    assert((int)fields_.size() == schema_->size());
+  }
+
+  // schema has to match d, it is interned from d if null
+  static TensorRecord fromDict(const TensorDict& d, SchemaPtr schema = nullptr) {
+    if (schema == nullptr) {
+      schema = Schema::of(d);
+    }
+    assert((int)d.size() == schema->size());
+    TensorRecord record(std::move(schema));
+    for (auto& kv : d) {
+      int i = record.schema_->indexOf(kv.first);
+      assert(i >= 0);
+      record.fields_[i] = kv.second;
+    }
+    return record;
+  }
+
+  TensorDict toDict() const {
+    TensorDict d;
+    for (int i = 0; i < size(); ++i) {
+      d.insert({schema_->key(i), fields_[i]});
+    }
+    return d;
+  }
+
+  bool empty() const {
+    return schema_ == nullptr;
+  }
+
+  int size() const {
+    return fields_.size();
+  }
+
+  const SchemaPtr& schema() const {
+    return schema_;
+  }
+
+  torch::Tensor& operator[](int i) {
+    return fields_[i];
+  }
+
+  const torch::Tensor& operator[](int i) const {
+    return fields_[i];
+  }
+
+  const torch::Tensor& at(const std::string& key) const {
+    int i = schema_->indexOf(key);
+    assert(i >= 0);
+    return fields_[i];
+  }
+
+ private:
+  SchemaPtr schema_;
+  c10::SmallVector<torch::Tensor, 8> fields_;
+};
+
+namespace tensor_record {
+
+// [size, ...] zero storage for every field of data
+inline TensorRecord allocateBatchStorage(const TensorRecord& data, int size) {
+  TensorRecord storage(data.schema());
+  for (int i = 0; i < data.size(); ++i) {
+    auto sizes = data[i].sizes().vec();
+    sizes.insert(sizes.begin(), size);
+    storage[i] = torch::zeros(sizes, data[i].dtype());
+  }
+  return storage;
+}
+
+inline TensorRecord index(const TensorRecord& batch, int64_t i) {
+  TensorRecord result(batch.schema());
+  for (int k = 0; k < batch.size(); ++k) {
+    result[k] = batch[k][i];
+  }
+  return result;
+}
+
+inline TensorRecord narrow(const TensorRecord& batch, int64_t dim, int64_t start, int64_t len) {
+  TensorRecord result(batch.schema());
+  for (int k = 0; k < batch.size(); ++k) {
+    result[k] = batch[k].narrow(dim, start, len);
+  }
+  return result;
+}
+
+inline torch::jit::IValue toIValue(const TensorRecord& record, const torch::Device& device) {
+  torch::Dict<std::string, torch::Tensor> dict;
+  for (int i = 0; i < record.size(); ++i) {
+    dict.insert(record.schema()->key(i), record[i].to(device));
+  }
+  return torch::jit::IValue(dict);
+}
+
+// schema is reused if the output has its fields and replaced otherwise, so
+// repeated calls for the same method only intern once. tensors stay on the
+// device they are on
+inline TensorRecord fromIValue(const torch::jit::IValue& value, bool detach, SchemaPtr* schema) {
+  assert(schema != nullptr);
+  auto dict = value.toGenericDict();
+  bool match = *schema != nullptr && (*schema)->size() == (int)dict.size();
+  for (auto& name2tensor : dict) {
+    if (!match) {
+      break;
+    }
+    match = (*schema)->indexOf(name2tensor.key().toString()->string()) >= 0;
+  }
+  if (!match) {
+    std::vector<std::string> keys;
+    for (auto& name2tensor : dict) {
+      keys.push_back(name2tensor.key().toString()->string());
+    }
+    *schema = Schema::intern(keys);
+  }
+  TensorRecord record(*schema);
+  for (auto& name2tensor : dict) {
+    int i = (*schema)->indexOf(name2tensor.key().toString()->string());
+    assert(i >= 0);
+    torch::Tensor tensor = name2tensor.value().toTensor();
+    if (detach) {
+      tensor = tensor.detach();
+    }
+    record[i] = tensor;
+  }
+  return record;
+}
+
+}  // namespace tensor_record
+}  // namespace rela
@@ -0,0 +1,311 @@
+// Behaviour tests of the replay side of rela: snapshot save/load, deferred
+// priority updates, eviction, the rate limiter, the disk tier and the
+// composite replay. Plain checks, no test framework, the first failure
+// exits with 1. Registered with ctest, see rela/CMakeLists.txt.
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include "rela/composite_replay.h"
+#include "rela/disk_tier.h"
+#include "rela/prioritized_replay.h"
+#include "rela/rate_limiter.h"
+#include "rela/serialize.h"
+
+using namespace rela;
+
+#define CHECK(cond)                                                           \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " << #cond \
+                << std::endl;                                                 \
+      std::exit(1);                                                           \
+    }                                                                         \
+  } while (0)
+
+#define CHECK_THROWS(stmt)          \
+  do {                              \
+    bool thrown = false;            \
+    try {                           \
+      stmt;                         \
+    } catch (std::runtime_error&) { \
+      thrown = true;                \
+    }                               \
+    CHECK(thrown);                  \
+  } while (0)
+
+namespace {
+
+TensorDict element(float v) {
+  return {{"x", torch::tensor({v})}};
+}
+
+float valueOf(const TensorDict& d) {
+  return d.at("x").item<float>();
+}
+
+std::string tmpPath(const std::string& name) {
+  return "/tmp/rela_test_" + std::to_string(getpid()) + "_" + name;
+}
+
+// values of a queue from oldest to newest
+std::vector<float> values(ConcurrentQueue<TensorDict>& q) {
+  std::vector<float> vals;
+  int size = q.safeSize(nullptr);
+  for (int i = 0; i < size; ++i) {
+    vals.push_back(valueOf(q.get(i)));
+  }
+  return vals;
+}
+
+void testSerialize() {
+  std::ostringstream os;
+  serialize::Writer writer(os);
+  TensorDict d = {{"a", torch::arange(6).reshape({2, 3})}, {"b", torch::ones({4})}};
+  writer.write(d);
+  auto bytes = os.str();
+
+  serialize::Reader reader(bytes.data(), bytes.size());
+  auto back = reader.readTensorDict();
+  CHECK(back.size() == 2);
+  CHECK(torch::equal(back.at("a"), d.at("a")));
+  CHECK(torch::equal(back.at("b"), d.at("b")));
+
+  // cut off in the middle of the data
+  serialize::Reader truncated(bytes.data(), bytes.size() - 1);
+  CHECK_THROWS(truncated.readTensorDict());
+
+  // dtype byte of the first tensor, after [num][len]["a"]
+  auto corrupt = bytes;
+  corrupt[sizeof(uint32_t) * 2 + 1] = 100;
+  serialize::Reader bad(corrupt.data(), corrupt.size());
+  CHECK_THROWS(bad.readTensorDict());
+}
+
+void testSaveLoad() {
+  auto path = tmpPath("snapshot");
+  TensorDictReplay replay(16, 1, 0.9, 0.4, 0);
+  for (int i = 0; i < 10; ++i) {
+    replay.add(element(i), i + 1);
+  }
+  replay.save(path);
+  replay.waitSave();
+
+  TensorDictReplay loaded(16, 2, 0.9, 0.4, 0);
+  loaded.load(path);
+  CHECK(loaded.size() == 10);
+  for (int i = 0; i < 10; ++i) {
+    CHECK(valueOf(loaded.get(i)) == i);
+  }
+
+  // only the newest capacity elements are kept
+  TensorDictReplay small(4, 3, 0.9, 0.4, 0);
+  small.load(path);
+  CHECK(small.size() == 4);
+  CHECK(valueOf(small.get(0)) == 6);
+
+  // a truncated snapshot throws instead of reading past the end
+  std::ifstream in(path, std::ios::binary);
+  std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  in.close();
+  std::ofstream(path, std::ios::binary).write(bytes.data(), bytes.size() / 2);
+  TensorDictReplay broken(16, 4, 0.9, 0.4, 0);
+  CHECK_THROWS(broken.load(path));
+  std::remove(path.c_str());
+  CHECK_THROWS(broken.load(path));
+}
+
+void testStaleUpdate() {
+  ConcurrentQueue<TensorDict> q(4);
+  for (int i = 0; i < 4; ++i) {
+    q.append(element(i), 1);
+  }
+  int64_t oldKey;
+  q.getWeight(0, &oldKey);
+
+  // element 0 leaves, its slot is reused by element 4
+  q.blockPop(1);
+  q.append(element(4), 5);
+  int64_t newKey;
+  CHECK(q.getWeight(3, &newKey) == 5);
+  CHECK((newKey & 0xffffffff) == (oldKey & 0xffffffff));
+  CHECK(newKey != oldKey);
+
+  q.update({oldKey}, torch::tensor({100.0f}));
+  int64_t key;
+  CHECK(q.getWeight(3, &key) == 5);
+  float sum;
+  q.safeSize(&sum);
+  CHECK(sum == 8);
+
+  // the current key does apply
+  q.update({newKey}, torch::tensor({2.0f}));
+  CHECK(q.getWeight(3, &key) == 2);
+  q.safeSize(&sum);
+  CHECK(sum == 5);
+}
+
+void testEvictFifo() {
+  std::mt19937 rng(1);
+  ConcurrentQueue<TensorDict> q(8, EvictionPolicy::kFifo);
+  for (int i = 0; i < 5; ++i) {
+    q.append(element(i), 1);
+  }
+  q.evict(2, rng);
+  CHECK((values(q) == std::vector<float>{2, 3, 4}));
+}
+
+void testEvictLowest() {
+  std::mt19937 rng(1);
+  ConcurrentQueue<TensorDict> q(8, EvictionPolicy::kLowestPriority);
+  std::vector<float> weights = {3, 1, 4, 2, 5};
+  for (int i = 0; i < 5; ++i) {
+    q.append(element(i), weights[i]);
+  }
+  q.evict(2, rng);
+  auto vals = values(q);
+  CHECK((std::set<float>(vals.begin(), vals.end()) == std::set<float>{0, 2, 4}));
+  float sum;
+  CHECK(q.safeSize(&sum) == 3);
+  CHECK(sum == 12);
+  for (int i = 0; i < 3; ++i) {
+    int64_t key;
+    CHECK(q.getWeight(i, &key) == weights[(int)valueOf(q.get(i))]);
+  }
+}
+
+void testEvictReservoir() {
+  // 6 elements, 2 evicted: every element is kept with probability 4 / 6
+  int numTrial = 5000;
+  std::vector<int> kept(6, 0);
+  for (int t = 0; t < numTrial; ++t) {
+    std::mt19937 rng(t);
+    ConcurrentQueue<TensorDict> q(8, EvictionPolicy::kReservoir);
+    for (int i = 0; i < 6; ++i) {
+      q.append(element(i), 1);
+    }
+    q.evict(2, rng);
+    auto vals = values(q);
+    CHECK(vals.size() == 4);
+    CHECK(std::set<float>(vals.begin(), vals.end()).size() == 4);
+    for (auto v : vals) {
+      ++kept[(int)v];
+    }
+  }
+  for (int i = 0; i < 6; ++i) {
+    CHECK(std::abs(kept[i] / (float)numTrial - 4.0f / 6) < 0.03);
+  }
+}
+
+void testRateLimiterInterrupt() {
+  RateLimiter limiter(1, 10, 5);
+  std::atomic_bool cancel{false};
+  std::atomic_bool done{false};
+  bool result = true;
+  std::thread sampler([&] {
+    result = limiter.awaitSample(4, &cancel);
+    done = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CHECK(!done);
+  // an interrupt without cancel keeps it waiting
+  limiter.interrupt();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CHECK(!done);
+  cancel = true;
+  limiter.interrupt();
+  sampler.join();
+  CHECK(!result);
+}
+
+void testRateLimiterRestore() {
+  RateLimiter limiter(2, 10, 5);
+  std::atomic_bool done{false};
+  std::thread sampler([&] {
+    CHECK(limiter.awaitSample(4));
+    done = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CHECK(!done);
+  // 20 loaded elements, the 10 beyond minSizeToSample count as sampled
+  limiter.restore(20);
+  sampler.join();
+  auto stats = limiter.stats();
+  CHECK(stats["num_insert"] == 20);
+  CHECK(stats["num_sample"] == 24);
+  // balanced, neither side blocks right away
+  CHECK(limiter.awaitInsert(1));
+  CHECK(limiter.awaitSample(2));
+}
+
+void testDiskTier() {
+  auto path = tmpPath("disk_tier");
+  {
+    DiskTier<TensorDict> disk(path, 4, 256);
+    disk.write(2, element(7));
+    disk.write(0, element(3));
+    CHECK(valueOf(disk.read(2)) == 7);
+    CHECK(valueOf(disk.read(0)) == 3);
+    TensorDict big = {{"x", torch::zeros({1024})}};
+    CHECK_THROWS(disk.write(1, big));
+  }
+  CHECK(access(path.c_str(), F_OK) != 0);
+  CHECK_THROWS(DiskTier<TensorDict>("/nonexistent/rela_test", 4, 256));
+}
+
+void testCompositeWait() {
+  CompositeReplay<TensorDict> composite(1, 0.9, 0.4);
+  auto a = composite.addBuffer("a", 16);
+  auto b = composite.addBuffer("b", 16);
+  std::atomic_bool done{false};
+  TensorDict batch;
+  std::thread learner([&] {
+    std::tie(batch, std::ignore) = composite.sample(4, "cpu");
+    done = true;
+  });
+  a->add(element(0));
+  a->add(element(1));
+  a->add(element(2));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  // b cannot supply its half yet
+  CHECK(!done);
+  b->add(element(10));
+  b->add(element(11));
+  learner.join();
+  CHECK(batch.at("x").size(0) == 4);
+  composite.updatePriority(torch::ones({4}));
+  CHECK(composite.stats()["b"]["num_sampled"] == 2);
+
+  // terminate wakes a waiting sample
+  std::thread waiting([&] { CHECK_THROWS(composite.sample(64, "cpu")); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  composite.terminate();
+  waiting.join();
+}
+
+}  // namespace
+
+int main() {
+  std::vector<std::pair<std::string, void (*)()>> tests = {
+      {"serialize", testSerialize},
+      {"save_load", testSaveLoad},
+      {"stale_update", testStaleUpdate},
+      {"evict_fifo", testEvictFifo},
+      {"evict_lowest", testEvictLowest},
+      {"evict_reservoir", testEvictReservoir},
+      {"rate_limiter_interrupt", testRateLimiterInterrupt},
+      {"rate_limiter_restore", testRateLimiterRestore},
+      {"disk_tier", testDiskTier},
+      {"composite_wait", testCompositeWait},
+  };
+  for (auto& test : tests) {
+    test.second();
+    std::cout << "ok: " << test.first << std::endl;
+  }
+  return 0;
+}
@@ -24,11 +24,10 @@ class ThreadLoop {
 
   virtual void terminate() {
     terminated_ = true;
-    if (paused()) {
-      resume();
-    }
+    resume();
   }
 
+  // request a pause, the loop parks itself at its next waitUntilResume()
   virtual void pause() {
     std::lock_guard<std::mutex> lk(mPaused_);
     paused_ = true;
@@ -39,12 +38,36 @@ class ThreadLoop {
       std::lock_guard<std::mutex> lk(mPaused_);
       paused_ = false;
     }
-    cvPaused_.notify_one();
+    cvPaused_.notify_all();
   }
 
+  // called by mainLoop at points where it is safe to be paused, e.g. no
+  // request in flight. costs a single atomic load when not paused
   virtual void waitUntilResume() {
+    if (!paused_) {
+      return;
+    }
+    beforePark();
+    std::unique_lock<std::mutex> lk(mPaused_);
+    parked_ = true;
+    cvPaused_.notify_all();
+    cvPaused_.wait(lk, [this] { return !paused_ || terminated_; });
+    parked_ = false;
+  }
+
+  // block until the loop is parked in waitUntilResume() or has left mainLoop
+  virtual void waitUntilPaused() {
     std::unique_lock<std::mutex> lk(mPaused_);
-    cvPaused_.wait(lk, [this] { return !paused_; });
+    cvPaused_.wait(lk, [this] { return !paused_ || parked_ || exited_; });
+  }
+
+  // called by the owner thread once mainLoop has returned
+  void markExited() {
+    {
+      std::lock_guard<std::mutex> lk(mPaused_);
+      exited_ = true;
+    }
+    cvPaused_.notify_all();
   }
 
   virtual bool terminated() {
@@ -57,11 +80,19 @@ class ThreadLoop {
 
   virtual void mainLoop() = 0;
 
+ protected:
+  // finish work that may still be in flight at the pause point, runs on the
+  // loop's thread right before it parks
+  virtual void beforePark() {
+  }
+
  private:
   std::atomic_bool terminated_{false};
 
   std::mutex mPaused_;
-  bool paused_ = false;
+  std::atomic_bool paused_{false};
+  bool parked_ = false;
+  bool exited_ = false;
   std::condition_variable cvPaused_;
 };
 
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// scoped timeline events that can be dumped as chrome trace json and opened
+// in chrome://tracing or ui.perfetto.dev. the RELA_TRACE_* macros compile
+// to nothing unless built with -DRELA_TRACE (cmake -DRELA_TRACE=ON), and
+// when compiled in they only record between trace::start() and stop().
+// each thread writes to its own fixed size ring, old events are dropped.
+//
+// the state is in function local statics, so rela and hanalearn (python
+// extensions with hidden visibility) each record their own threads: start,
+// stop & dump are bound in both modules, pyhanabi merges the two dumps.
+// timestamps are steady_clock time, which is the same in both
+//
+//   RELA_TRACE_THREAD("actor");       // once per thread, optional
+//   { RELA_TRACE_SCOPE("act"); ... }  // name must be a string literal
+//
+//   RELA_TRACE_PHASES(step);          // consecutive spans in one scope,
+//   RELA_TRACE_NEXT(step, "observe"); // each one ends the previous
+//   ...
+//   RELA_TRACE_NEXT(step, "act");
+
+#ifdef RELA_TRACE
+#define RELA_TRACE_CAT_(a, b) a##b
+#define RELA_TRACE_CAT(a, b) RELA_TRACE_CAT_(a, b)
+#define RELA_TRACE_SCOPE(name) \
+  rela::trace::Scope RELA_TRACE_CAT(relaTraceScope, __LINE__)(name)
+#define RELA_TRACE_THREAD(name) rela::trace::setThreadName(name)
+#define RELA_TRACE_PHASES(var) rela::trace::Phases var
+#define RELA_TRACE_NEXT(var, name) var.next(name)
+#else
+#define RELA_TRACE_SCOPE(name)
+#define RELA_TRACE_THREAD(name)
+#define RELA_TRACE_PHASES(var)
+#define RELA_TRACE_NEXT(var, name)
+#endif
+
+namespace rela {
+namespace trace {
+
+struct Event {
+  const char* name;
+  int64_t startUs;
+  int64_t durUs;
+};
+
+class ThreadBuffer {
+ public:
+  static constexpr int kCapacity = 1 << 16;
+
+  ThreadBuffer(int tid)
+      : tid(tid)
+      , events_(kCapacity) {
+  }
+
+  // only called by the owning thread, the lock is uncontended unless a dump
+  // is in progress
+  void add(const Event& event) {
+    std::lock_guard<std::mutex> lk(m_);
+    events_[numEvent_ % kCapacity] = event;
+    ++numEvent_;
+  }
+
+  std::vector<Event> events() {
+    std::lock_guard<std::mutex> lk(m_);
+    int64_t first = std::max(int64_t(0), numEvent_ - kCapacity);
+    std::vector<Event> events;
+    for (int64_t i = first; i < numEvent_; ++i) {
+      events.push_back(events_[i % kCapacity]);
+    }
+    return events;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lk(m_);
+    numEvent_ = 0;
+  }
+
+  const int tid;
+  std::string name;
+
+ private:
+  std::mutex m_;
+  std::vector<Event> events_;
+  int64_t numEvent_ = 0;
+};
+
+inline std::atomic<bool>& recording() {
+  static std::atomic<bool> flag{false};
+  return flag;
+}
+
+inline std::mutex& registryMutex() {
+  static std::mutex m;
+  return m;
+}
+
+// buffers outlive their threads so that events of finished threads can
+// still be dumped
+inline std::vector<std::shared_ptr<ThreadBuffer>>& registry() {
+  static std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  return buffers;
+}
+
+inline ThreadBuffer& threadBuffer() {
+  static thread_local std::shared_ptr<ThreadBuffer> buffer = [] {
+    std::lock_guard<std::mutex> lk(registryMutex());
+    auto buffer = std::make_shared<ThreadBuffer>((int)registry().size());
+    registry().push_back(buffer);
+    return buffer;
+  }();
+  return *buffer;
+}
+
+inline int64_t nowUs() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+// whether the RELA_TRACE_* macros are compiled in
+inline bool compiledIn() {
+#ifdef RELA_TRACE
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline void setThreadName(const std::string& name) {
+  auto& buffer = threadBuffer();
+  std::lock_guard<std::mutex> lk(registryMutex());
+  buffer.name = name;
+}
+
+// drops events recorded so far
+inline void start() {
+  if (!compiledIn()) {
+    std::cout << "Warning: rela is built without RELA_TRACE, trace will be empty"
+              << std::endl;
+  }
+  {
+    std::lock_guard<std::mutex> lk(registryMutex());
+    for (auto& buffer : registry()) {
+      buffer->clear();
+    }
+  }
+  recording() = true;
+}
+
+inline void stop() {
+  recording() = false;
+}
+
+// writes the events currently held by the rings, can be called while
+// recording. pid tells apart the dumps of different modules
+inline void dump(const std::string& path, int pid = 0) {
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lk(registryMutex());
+    buffers = registry();
+  }
+
+  std::ofstream out(path);
+  if (!out) {
+    std::cout << "Error: cannot open trace file " << path << std::endl;
+    return;
+  }
+  out << "{\"traceEvents\":[";
+  bool first = true;
+  for (auto& buffer : buffers) {
+    std::string name;
+    {
+      std::lock_guard<std::mutex> lk(registryMutex());
+      name = buffer->name.empty() ? "thread_" + std::to_string(buffer->tid) : buffer->name;
+    }
+    out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+        << ",\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"" << name << "\"}}";
+    first = false;
+    for (auto& event : buffer->events()) {
+      out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << pid
+          << ",\"tid\":" << buffer->tid << ",\"ts\":" << event.startUs
+          << ",\"dur\":" << event.durUs << "}";
+    }
+  }
+  out << "\n]}\n";
+}
+
+class Scope {
+ public:
+  Scope(const char* name)
+      : name_(name)
+      , startUs_(recording() ? nowUs() : -1) {
+  }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+  ~Scope() {
+    if (startUs_ < 0) {
+      return;
+    }
+    threadBuffer().add({name_, startUs_, nowUs() - startUs_});
+  }
+
+ private:
+  const char* const name_;
+  const int64_t startUs_;
+};
+
+class Phases {
+ public:
+  Phases() = default;
+
+  Phases(const Phases&) = delete;
+  Phases& operator=(const Phases&) = delete;
+
+  ~Phases() {
+    end();
+  }
+
+  void next(const char* name) {
+    end();
+    name_ = name;
+    startUs_ = recording() ? nowUs() : -1;
+  }
+
+ private:
+  void end() {
+    if (startUs_ < 0) {
+      return;
+    }
+    int64_t now = nowUs();
+    threadBuffer().add({name_, startUs_, now - startUs_});
+    startUs_ = -1;
+  }
+
+  const char* name_ = nullptr;
+  int64_t startUs_ = -1;
+};
+
+}  // namespace trace
+}  // namespace rela
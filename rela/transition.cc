@@ -5,6 +5,7 @@
 // LICENSE file in the root directory of this source tree.
 //
 #include "rela/transition.h"
+#include "rela/packed_tensors.h"
 #include "rela/utils.h"
 
 using namespace rela;
@@ -93,12 +94,123 @@ RNNTransition RNNTransition::index(int i) const {
   element.terminal = terminal[i];
   element.bootstrap = bootstrap[i];
   element.seqLen = seqLen[i];
+
+  for (auto& name2tensor : episodeObs) {
+    element.episodeObs.insert({name2tensor.first, name2tensor.second[i]});
+  }
+  element.zeroH0 = zeroH0;
   return element;
 }
 
-TensorDict RNNTransition::toDict() {
+namespace {
+
+// [dims...] -> [len, dims...] without copy
+torch::Tensor broadcastTime(const torch::Tensor& t, int64_t len) {
+  auto sizes = t.sizes().vec();
+  sizes.insert(sizes.begin(), len);
+  return t.unsqueeze(0).expand(sizes);
+}
+
+// collects the output tensors of a batch and then gathers all of them into
+// one packed host buffer (taken from staging if given), which is moved to
+// device with a single copy
+class Gather {
+ public:
+  // *out = [len, B, ...] from ts[i] = [T_i, ...], the tail padded with value
+  void padStack(torch::Tensor* out, const std::vector<torch::Tensor>& ts, int64_t len, float value) {
+    auto sizes = ts[0].sizes().vec();
+    sizes[0] = len;
+    sizes.insert(sizes.begin() + 1, (int64_t)ts.size());
+    jobs_.push_back({out, ts, sizes, 1, value, true});
+  }
+
+  void padStack(TensorDict* out, const std::vector<TensorDict>& dicts, int64_t len) {
+    for (auto& kv : dicts[0]) {
+      padStack(&(*out)[kv.first], column(dicts, kv.first), len, 0);
+    }
+  }
+
+  // *out = stack(ts, dim)
+  void stack(torch::Tensor* out, const std::vector<torch::Tensor>& ts, int64_t dim) {
+    auto sizes = ts[0].sizes().vec();
+    sizes.insert(sizes.begin() + dim, (int64_t)ts.size());
+    jobs_.push_back({out, ts, sizes, dim, 0, false});
+  }
+
+  void stack(TensorDict* out, const std::vector<TensorDict>& dicts, int64_t dim) {
+    for (auto& kv : dicts[0]) {
+      stack(&(*out)[kv.first], column(dicts, kv.first), dim);
+    }
+  }
+
+  void run(const std::string& device, StagingArena* staging) {
+    if (jobs_.empty()) {
+      return;
+    }
+    std::vector<std::vector<int64_t>> sizes;
+    std::vector<torch::Dtype> dtypes;
+    for (auto& job : jobs_) {
+      sizes.push_back(job.sizes);
+      dtypes.push_back(job.ts[0].scalar_type());
+    }
+    PackedTensors packed(sizes, dtypes, staging, device != "cpu");
+    auto views = packed.unpack();
+    for (size_t k = 0; k < jobs_.size(); ++k) {
+      auto& job = jobs_[k];
+      for (size_t i = 0; i < job.ts.size(); ++i) {
+        auto dst = views[k].select(job.dim, i);
+        if (job.pad) {
+          int64_t len = job.ts[i].size(0);
+          dst.narrow(0, 0, len).copy_(job.ts[i]);
+          if (len < dst.size(0)) {
+            dst.narrow(0, len, dst.size(0) - len).fill_(job.value);
+          }
+        } else {
+          dst.copy_(job.ts[i]);
+        }
+      }
+    }
+    if (device != "cpu") {
+      views = packed.to(torch::Device(device)).unpack();
+    }
+    for (size_t k = 0; k < jobs_.size(); ++k) {
+      *jobs_[k].out = views[k];
+    }
+  }
+
+ private:
+  struct Job {
+    torch::Tensor* out;
+    std::vector<torch::Tensor> ts;
+    std::vector<int64_t> sizes;
+    int64_t dim;
+    float value;
+    bool pad;
+  };
+
+  static std::vector<torch::Tensor> column(
+      const std::vector<TensorDict>& dicts, const std::string& key) {
+    std::vector<torch::Tensor> ts(dicts.size());
+    for (size_t i = 0; i < dicts.size(); ++i) {
+      assert(dicts[i].size() == dicts[0].size());
+      ts[i] = dicts[i].at(key);
+    }
+    return ts;
+  }
+
+  std::vector<Job> jobs_;
+};
+
+}  // namespace
+
+TensorDict RNNTransition::toDict() const {
   auto dict = obs;
 
+  for (auto& kv : episodeObs) {
+    auto ret = dict.emplace(kv.first, broadcastTime(kv.second, reward.size(0)));
+    assert(ret.second);
+  }
+
   for (auto& kv : action) {
     auto ret = dict.emplace(kv.first, kv.second);
     assert(ret.second);
@@ -147,21 +259,28 @@ FFTransition rela::makeBatch(
   batch.nextObs = tensor_dict::stack(nextObsVec, 0);
 
   if (device != "cpu") {
-    auto d = torch::Device(device);
-    auto toDevice = [&](const torch::Tensor& t) { return t.to(d); };
-    batch.obs = tensor_dict::apply(batch.obs, toDevice);
-    batch.action = tensor_dict::apply(batch.action, toDevice);
-    batch.reward = batch.reward.to(d);
-    batch.terminal = batch.terminal.to(d);
-    batch.bootstrap = batch.bootstrap.to(d);
-    batch.nextObs = tensor_dict::apply(batch.nextObs, toDevice);
+    // one host to device copy for the whole batch
+    std::vector<torch::Tensor*> fields = {&batch.reward, &batch.terminal, &batch.bootstrap};
+    for (auto dict : {&batch.obs, &batch.action, &batch.nextObs}) {
+      for (auto& kv : *dict) {
+        fields.push_back(&kv.second);
+      }
+    }
+    packedTo(fields, torch::Device(device));
   }
 
   return batch;
 }
 
 RNNTransition rela::makeBatch(
-    const std::vector<RNNTransition>& transitions, const std::string& device) {
+    const std::vector<RNNTransition>& transitions,
+    const std::string& device,
+    const std::vector<std::string>& keys,
+    StagingArena* staging) {
+  auto project = [&](const TensorDict& d) {
+    return keys.empty() ? d : tensor_dict::select(d, keys);
+  };
+
   std::vector<TensorDict> obsVec;
   std::vector<TensorDict> h0Vec;
   std::vector<TensorDict> actionVec;
@@ -169,49 +288,78 @@ RNNTransition rela::makeBatch(
   std::vector<torch::Tensor> terminalVec;
   std::vector<torch::Tensor> bootstrapVec;
   std::vector<torch::Tensor> seqLenVec;
+  std::vector<TensorDict> episodeObsVec;
+  bool zeroH0 = true;
 
   for (size_t i = 0; i < transitions.size(); i++) {
-    obsVec.push_back(transitions[i].obs);
-    h0Vec.push_back(transitions[i].h0);
-    actionVec.push_back(transitions[i].action);
+    obsVec.push_back(project(transitions[i].obs));
+    zeroH0 = zeroH0 && transitions[i].zeroH0;
+    h0Vec.push_back(project(transitions[i].h0));
+    episodeObsVec.push_back(project(transitions[i].episodeObs));
+    actionVec.push_back(project(transitions[i].action));
     rewardVec.push_back(transitions[i].reward);
     terminalVec.push_back(transitions[i].terminal);
     bootstrapVec.push_back(transitions[i].bootstrap);
     seqLenVec.push_back(transitions[i].seqLen);
   }
 
+  int64_t maxLen = 0;
+  for (auto& t : rewardVec) {
+    maxLen = std::max(maxLen, t.size(0));
+  }
+
   RNNTransition batch;
-  batch.obs = tensor_dict::stack(obsVec, 1);
-  batch.h0 = tensor_dict::stack(h0Vec, 1);  // 1 is batch for rnn hid
-  batch.action = tensor_dict::stack(actionVec, 1);
-  batch.reward = torch::stack(rewardVec, 1);
-  batch.terminal = torch::stack(terminalVec, 1);
-  batch.bootstrap = torch::stack(bootstrapVec, 1);
-  batch.seqLen = torch::stack(seqLenVec, 0);
+  Gather gather;
+  gather.padStack(&batch.obs, obsVec, maxLen);
+  if (!zeroH0) {
+    gather.stack(&batch.h0, h0Vec, 1);  // 1 is batch for rnn hid
+  }
+  gather.padStack(&batch.action, actionVec, maxLen);
+  gather.padStack(&batch.reward, rewardVec, maxLen, 0);
+  gather.padStack(&batch.terminal, terminalVec, maxLen, 1);
+  gather.padStack(&batch.bootstrap, bootstrapVec, maxLen, 0);
+  gather.stack(&batch.seqLen, seqLenVec, 0);
+  if (episodeObsVec.size() > 0 && episodeObsVec[0].size() > 0) {
+    gather.stack(&batch.episodeObs, episodeObsVec, 0);
+  }
+  // one host to device copy for the whole batch
+  gather.run(device, staging);
 
-  if (device != "cpu") {
-    auto d = torch::Device(device);
-    auto toDevice = [&](const torch::Tensor& t) { return t.to(d); };
-    batch.obs = tensor_dict::apply(batch.obs, toDevice);
-    batch.h0 = tensor_dict::apply(batch.h0, toDevice);
-    batch.action = tensor_dict::apply(batch.action, toDevice);
-    batch.reward = batch.reward.to(d);
-    batch.terminal = batch.terminal.to(d);
-    batch.bootstrap = batch.bootstrap.to(d);
-    batch.seqLen = batch.seqLen.to(d);
+  if (zeroH0) {
+    // create the zero state directly on device instead of stack & copy
+    int64_t batchsize = transitions.size();
+    for (auto& kv : h0Vec[0]) {
+      auto sizes = kv.second.sizes().vec();
+      sizes.insert(sizes.begin() + 1, batchsize);
+      batch.h0[kv.first] = torch::zeros(sizes, kv.second.options().device(device));
+    }
+  }
+  batch.zeroH0 = zeroH0;
+
+  // broadcast per episode constants over time, learner sees [T, B, ...]
+  for (auto& kv : batch.episodeObs) {
+    auto ret = batch.obs.emplace(kv.first, broadcastTime(kv.second, batch.reward.size(0)));
+    assert(ret.second);
   }
 
   return batch;
 }
 
 TensorDict rela::makeBatch(
-    const std::vector<TensorDict>& transitions, const std::string& device) {
-  auto batch = tensor_dict::stack(transitions, 0);
-  if (device != "cpu") {
-    auto d = torch::Device(device);
-    for (auto& kv : batch) {
-      batch[kv.first] = kv.second.to(d);
+    const std::vector<TensorDict>& transitions,
+    const std::string& device,
+    const std::vector<std::string>& keys,
+    StagingArena* staging) {
+  if (!keys.empty()) {
+    std::vector<TensorDict> projected;
+    for (auto& t : transitions) {
+      projected.push_back(tensor_dict::select(t, keys));
     }
+    return makeBatch(projected, device, {}, staging);
   }
+  TensorDict batch;
+  Gather gather;
+  gather.stack(&batch, transitions, 0);
+  gather.run(device, staging);
   return batch;
 }
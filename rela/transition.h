@@ -12,6 +12,8 @@
 
 namespace rela {
 
+class StagingArena;
+
 class FFTransition {
  public:
   FFTransition() = default;
@@ -53,7 +55,7 @@ class RNNTransition {
 
   RNNTransition index(int i) const;
 
-  TensorDict toDict();
+  TensorDict toDict() const;
 
   TensorDict obs;
   TensorDict h0;
@@ -62,15 +64,35 @@ class RNNTransition {
   torch::Tensor terminal;
   torch::Tensor bootstrap;
   torch::Tensor seqLen;
+
+  // obs, action, reward, terminal & bootstrap are [seqLen, ...] for a single
+  // episode in replay, makeBatch pads them to the longest one in the batch
+
+  // per episode constants such as eps, no time dim, broadcast into obs by
+  // toDict & makeBatch
+  TensorDict episodeObs;
+  // h0 is the model's zero initial state, makeBatch creates it on device
+  bool zeroH0 = false;
 };
 
 FFTransition makeBatch(
     const std::vector<FFTransition>& transitions, const std::string& device);
 
+// keys projects obs, h0, action & episodeObs (and a TensorDict) to the
+// given keys before anything is stacked or copied, empty keeps everything.
+// reward, terminal, bootstrap & seqLen are always kept.
+// the batch is gathered into one host buffer, taken from staging if given
+// and page-locked if device is not cpu, and then copied to device at once
 RNNTransition makeBatch(
-    const std::vector<RNNTransition>& transitions, const std::string& device);
+    const std::vector<RNNTransition>& transitions,
+    const std::string& device,
+    const std::vector<std::string>& keys = {},
+    StagingArena* staging = nullptr);
 
 TensorDict makeBatch(
-    const std::vector<TensorDict>& transitions, const std::string& device);
+    const std::vector<TensorDict>& transitions,
+    const std::string& device,
+    const std::vector<std::string>& keys = {},
+    StagingArena* staging = nullptr);
 
 }  // namespace rela
@@ -7,8 +7,6 @@
 
 using namespace std;
 
-#define PR false
-
 tuple<bool, bool> Actor::analyzeCardBelief(const vector<float>& b) {
     assert(b.size() == 25);
     set<int> colors;
@@ -21,6 +21,9 @@ public:
         (void)env; (void)curPlayer;}
     virtual void fictAct(const HanabiEnv& env) { (void)env; }
     virtual void observeAfterAct(const HanabiEnv& env) { (void)env; }
+    // wait for requests that stay in flight across steps, called before
+    // the thread loop parks for a pause
+    virtual void flushPending() {}
 
     std::tuple<int, int, int, int> getPlayedCardInfo() const {
         return {noneKnown_, colorKnown_, rankKnown_, bothKnown_};
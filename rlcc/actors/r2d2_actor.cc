@@ -4,13 +4,13 @@
 // This source code is licensed under the license found in the
 // LICENSE file in the root directory of this source tree.
 #include <stdio.h>
+#include <algorithm>
 #include <iostream>
 
 #include "rlcc/actors/r2d2_actor.h"
+#include "rlcc/debug_log.h"
 #include "rlcc/utils.h"
 
-#define PR false
-
 using namespace std;
 
 void addHid(rela::TensorDict& to, rela::TensorDict& hid) {
@@ -33,6 +33,16 @@ void moveHid(rela::TensorDict& from, rela::TensorDict& hid) {
     }
 }
 
+// index of every field of hid in schema
+std::vector<int> hidIndex(const rela::SchemaPtr& schema, const rela::TensorRecord& hid) {
+    std::vector<int> index(hid.size());
+    for (int i = 0; i < hid.size(); ++i) {
+        index[i] = schema->indexOf(hid.schema()->key(i));
+        assert(index[i] >= 0);
+    }
+    return index;
+}
+
 //std::vector<hle::HanabiCardValue> sampleCards(
         //const std::vector<float>& v0,
         //const std::vector<int>& privCardCount,
@@ -117,15 +127,11 @@ void moveHid(rela::TensorDict& from, rela::TensorDict& hid) {
 //}
 
 void R2D2Actor::reset(const HanabiEnv& env) {
-    hidden_ = getH0(batchsize_, runner_);
+    hidden_ = rela::TensorRecord::fromDict(getH0(batchsize_, runner_));
     if (beliefRunner_ != nullptr) {
         beliefHidden_ = getH0(batchsize_, beliefRunner_);
     }
 
-    if (r2d2Buffer_ != nullptr) {
-        r2d2Buffer_->init(hidden_);
-    }
-
     //const auto& game = env.getHleGame();
     //int fixColorPlayer = -1;
     //if (vdn_ && shuffleColor_) {
@@ -162,15 +168,41 @@ void R2D2Actor::reset(const HanabiEnv& env) {
             //}
         //}
     }
+
+    if (r2d2Buffer_ != nullptr) {
+        // eps and temperature are fixed for the episode, store them once
+        rela::TensorDict episodeObs = {{"eps", torch::tensor(playerEps_)}};
+        if (playerTemp_.size() > 0) {
+            episodeObs["temperature"] = torch::tensor(playerTemp_);
+        }
+        r2d2Buffer_->init(hidden_.toDict(), episodeObs);
+    }
 }
 
 void R2D2Actor::observeBeforeAct(HanabiEnv& env) {
     torch::NoGradGuard ng;
     prevHidden_ = hidden_;
 
-    rela::TensorDict input;
     const auto& state = env.getHleState();
 
+    if (actSchema_ == nullptr) {
+        auto keys = ObserveIndex::keys(trinary_);
+        keys.push_back("eps");
+        if (playerTemp_.size() > 0) {
+            keys.push_back("temperature");
+        }
+        for (auto& key : hidden_.schema()->keys()) {
+            keys.push_back(key);
+        }
+        actSchema_ = rela::Schema::intern(keys);
+        assert(actSchema_->size() == (int)keys.size());
+        obsIndex_ = ObserveIndex(*actSchema_, trinary_);
+        epsIdx_ = actSchema_->indexOf("eps");
+        tempIdx_ = actSchema_->indexOf("temperature");
+        actHidIdx_ = hidIndex(actSchema_, hidden_);
+    }
+    rela::TensorRecord input(actSchema_);
+
     //if (vdn_) {
         //std::vector<rela::TensorDict> vObs;
         //for (int i = 0; i < numPlayer_; ++i) {
@@ -186,7 +218,7 @@ void R2D2Actor::observeBeforeAct(HanabiEnv& env) {
         //}
         //input = rela::tensor_dict::stack(vObs, 0);
     //} else {
-        input = observe(
+        observe(
                 state,
                 playerIdx_,
                 shuffleColor_,
@@ -194,18 +226,15 @@ void R2D2Actor::observeBeforeAct(HanabiEnv& env) {
                 invColorPermutes_[0],
                 hideAction_,
                 trinary_,
-                sad_);
+                sad_,
+                obsIndex_,
+                input);
     //}
 
-    // add features such as eps and temperature
-    input["eps"] = torch::tensor(playerEps_);
-    if (playerTemp_.size() > 0) {
-        input["temperature"] = torch::tensor(playerTemp_);
-    }
-
-    // push before we add hidden
+    // push before we add eps, temperature & hidden, the per episode
+    // features are stored once by r2d2Buffer_->init
     if (replayBuffer_ != nullptr) {
-        r2d2Buffer_->pushObs(input);
+        r2d2Buffer_->pushObs(input, obsIndex_.fields);
     } else {
         // eval mode, collect some stats
         const auto& game = env.getHleGame();
@@ -217,7 +246,14 @@ void R2D2Actor::observeBeforeAct(HanabiEnv& env) {
             extractPerCardBelief(privV0, env.getHleGame(), obs.Hands()[0].Cards().size());
     }
 
-    addHid(input, hidden_);
+    // add features such as eps and temperature
+    input[epsIdx_] = torch::tensor(playerEps_);
+    if (tempIdx_ >= 0) {
+        input[tempIdx_] = torch::tensor(playerTemp_);
+    }
+    for (int i = 0; i < hidden_.size(); ++i) {
+        input[actHidIdx_[i]] = hidden_[i];
+    }
 
     // no-blocking async call to neural network
     futReply_ = runner_->call("act", input);
@@ -258,11 +294,27 @@ void R2D2Actor::act(HanabiEnv& env, const int curPlayer) {
     torch::NoGradGuard ng;
 
     auto& state = env.getHleState();
-    auto reply = futReply_.get();
-    moveHid(reply, hidden_);
+    auto reply = futReply_.getRecord();
+    if (reply.schema() != replySchema_) {
+        replySchema_ = reply.schema();
+        actionIdx_ = replySchema_->indexOf("a");
+        assert(actionIdx_ >= 0);
+        replyHidIdx_ = hidIndex(replySchema_, hidden_);
+        // everything but the hidden goes into the replay
+        replyActionIdx_.clear();
+        for (int i = 0; i < replySchema_->size(); ++i) {
+            if (std::find(replyHidIdx_.begin(), replyHidIdx_.end(), i) == replyHidIdx_.end()) {
+                replyActionIdx_.push_back(i);
+            }
+        }
+    }
+    for (int i = 0; i < hidden_.size(); ++i) {
+        assert(reply[replyHidIdx_[i]].sizes() == hidden_[i].sizes());
+        hidden_[i] = reply[replyHidIdx_[i]];
+    }
 
     if (replayBuffer_ != nullptr) {
-        r2d2Buffer_->pushAction(reply);
+        r2d2Buffer_->pushAction(reply, replyActionIdx_);
     }
 
     //rela::TensorDict beliefReply;
@@ -278,7 +330,7 @@ void R2D2Actor::act(HanabiEnv& env, const int curPlayer) {
         //action = reply.at("a")[curPlayer].item<int64_t>();
         //invColorPermute = &(invColorPermutes_[curPlayer]);
     //} else {
-        action = reply.at("a").item<int64_t>();
+        action = reply[actionIdx_].item<int64_t>();
         //invColorPermute = &(invColorPermutes_[0]);
     //}
 
@@ -345,7 +397,8 @@ void R2D2Actor::act(HanabiEnv& env, const int curPlayer) {
     incrementPlayedCardKnowledgeCount(env, move);
     incrementStats(env, move);
 
-    if(PR)printf("Playing move: %s\n", move.ToString().c_str());
+    DEBUG_LOG(kMove, "move", "player=%d move=%s", playerIdx_,
+            debug_log::quote(move.ToString()).c_str());
     env.step(move);
 }
 
@@ -404,18 +457,26 @@ void R2D2Actor::act(HanabiEnv& env, const int curPlayer) {
     //futTarget_ = runner_->call("compute_target", fictInput);
 //}
 
+// the last episode waits for its priority until the next step, or until
+// the loop is paused
+void R2D2Actor::flushPending() {
+    if (futPriority_.isNull()) {
+        return;
+    }
+    auto priority = futPriority_.getRecord().at("priority").item<float>();
+    if (useExperience_) {
+        replayBuffer_->add(std::move(lastEpisode_), priority);
+    }
+    futPriority_ = rela::FutureReply();
+}
+
 void R2D2Actor::observeAfterAct(const HanabiEnv& env) {
     torch::NoGradGuard ng;
     if (replayBuffer_ == nullptr) {
         return;
     }
 
-    if (!futPriority_.isNull()) {
-        auto priority = futPriority_.get()["priority"].item<float>();
-        if (useExperience_) {
-            replayBuffer_->add(std::move(lastEpisode_), priority);
-        }
-    }
+    flushPending();
 
     float reward = env.stepReward();
     bool terminated = env.terminated();
@@ -424,16 +485,15 @@ void R2D2Actor::observeAfterAct(const HanabiEnv& env) {
 
     if (offBelief_) {
         assert(!futTarget_.isNull());
-        auto target = futTarget_.get()["target"];
-        auto ret = r2d2Buffer_->obsBack().emplace("target", target);
-        assert(ret.second);
-        ret = r2d2Buffer_->obsBack().emplace("valid_fict", torch::tensor(float(validFict_)));
-        assert(ret.second);
+        auto target = futTarget_.getRecord().at("target");
+        r2d2Buffer_->addObsBack("target", target);
+        r2d2Buffer_->addObsBack("valid_fict", torch::tensor(float(validFict_)));
     }
 
     if (terminated) {
         lastEpisode_ = r2d2Buffer_->popTransition();
-        auto input = lastEpisode_.toDict();
+        // batcher needs a fixed seq len
+        auto input = r2d2Buffer_->paddedTransition().toDict();
         futPriority_ = runner_->call("compute_priority", input);
     }
 }
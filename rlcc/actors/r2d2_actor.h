@@ -11,6 +11,7 @@
 #include "rela/r2d2.h"
 
 #include "rlcc/hanabi_env.h"
+#include "rlcc/utils.h"
 #include "rlcc/actors/actor.h"
 
 class R2D2Actor: public Actor {
@@ -94,6 +95,7 @@ public:
     void act(HanabiEnv& env, const int curPlayer) override;
     //void fictAct(const HanabiEnv& env) override;
     void observeAfterAct(const HanabiEnv& env) override;
+    void flushPending() override;
 
     void setPartners(std::vector<std::shared_ptr<R2D2Actor>> partners) {
         partners_ = std::move(partners);
@@ -146,8 +148,22 @@ protected:
     std::shared_ptr<rela::RNNPrioritizedReplay> replayBuffer_;
     std::unique_ptr<rela::R2D2Buffer> r2d2Buffer_;
 
-    rela::TensorDict prevHidden_;
-    rela::TensorDict hidden_;
+    // hidden state in the field order of getH0
+    rela::TensorRecord prevHidden_;
+    rela::TensorRecord hidden_;
+
+    // the act input & reply have the same fields on every step, their
+    // schemas & the indices of eps, temperature, action & hidden fields are
+    // looked up on the first step
+    rela::SchemaPtr actSchema_;
+    ObserveIndex obsIndex_;
+    int epsIdx_ = -1;
+    int tempIdx_ = -1;
+    std::vector<int> actHidIdx_;
+    rela::SchemaPtr replySchema_;
+    int actionIdx_ = -1;
+    std::vector<int> replyHidIdx_;
+    std::vector<int> replyActionIdx_;
 
     rela::FutureReply futReply_;
     rela::FutureReply futPriority_;
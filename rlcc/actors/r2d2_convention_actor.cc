@@ -7,7 +7,6 @@
 
 #include "rlcc/actors/r2d2_convention_actor.h"
 
-#define PR false
 using namespace std;
 
 hle::HanabiMove R2D2ConventionActor::getFicticiousTeammateMove(
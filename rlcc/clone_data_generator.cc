@@ -29,8 +29,13 @@ void DataGenLoop::shuffleColor(const hle::HanabiGame game) {
 
 void DataGenLoop::mainLoop() {
   assert(gameDatas_.size() > 0);
+  rela::SmallTensorPoolGuard poolGuard;
   std::vector<size_t> idxsLeft;
   while (!terminated()) {
+    waitUntilResume();
+    if (terminated()) {
+      break;
+    }
     if (idxsLeft.size() <= 0) {
       if (!infLoop_) {
         if (epoch_ == 0) {
@@ -96,9 +101,11 @@ void DataGenLoop::mainLoop() {
       }
     }
 
+    std::vector<rela::RNNTransition> transitions;
     for (int i = 0; i < numPlayer_; ++i) {
-      replayBuffer_->add(r2d2Buffers_[i].popTransition(), 1.0);
+      transitions.push_back(r2d2Buffers_[i].popTransition());
     }
+    replayBuffer_->addBlock(transitions, std::vector<float>(numPlayer_, 1.0));
   }  // while (!terminated())
 };
 
@@ -12,6 +12,7 @@
 #include "rela/context.h"
 #include "rela/prioritized_replay.h"
 #include "rela/r2d2.h"
+#include "rela/small_tensor_pool.h"
 #include "rela/thread_loop.h"
 
 namespace hle = hanabi_learning_env;
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// debug prints of the game loop & actors, grouped in categories that are
+// switched on at runtime, either with the HANABI_DEBUG env var
+// (e.g. HANABI_DEBUG=step,move) or hanalearn.set_debug_log("step,move").
+// a disabled DEBUG_LOG costs one relaxed atomic load, its arguments are not
+// evaluated. each event is written as one line of key=value fields,
+//
+//   category=move tid=3f2a event=move player=1 move="(Play 2)"
+//
+// whole, so the output of several threads does not interleave. values with
+// spaces or newlines go through quote()
+namespace debug_log {
+
+enum Category : uint32_t {
+    // phases of HanabiThreadLoop::mainLoop
+    kStep = 1 << 0,
+    // score, lives, deck & hands of the first env at each step
+    kState = 1 << 1,
+    // moves applied by the actors
+    kMove = 1 << 2,
+};
+
+inline const char* categoryName(Category category) {
+    switch (category) {
+        case kStep: return "step";
+        case kState: return "state";
+        case kMove: return "move";
+    }
+    return "unknown";
+}
+
+// comma separated category names, "all" or ""
+inline uint32_t parseCategories(const std::string& categories) {
+    uint32_t mask = 0;
+    std::stringstream ss(categories);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (name.empty()) {
+            continue;
+        }
+        if (name == "all") {
+            mask = kStep | kState | kMove;
+            continue;
+        }
+        bool found = false;
+        for (auto category : {kStep, kState, kMove}) {
+            if (name == categoryName(category)) {
+                mask |= category;
+                found = true;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Warning: unknown debug log category %s\n", name.c_str());
+        }
+    }
+    return mask;
+}
+
+inline std::atomic<uint32_t>& enabledMask() {
+    static std::atomic<uint32_t> mask{[] {
+        const char* env = getenv("HANABI_DEBUG");
+        return env == nullptr ? 0u : parseCategories(env);
+    }()};
+    return mask;
+}
+
+inline void setCategories(const std::string& categories) {
+    enabledMask() = parseCategories(categories);
+}
+
+inline bool enabled(Category category) {
+    return enabledMask().load(std::memory_order_relaxed) & category;
+}
+
+// s in double quotes, with quotes, backslashes & newlines escaped
+inline std::string quote(const std::string& s) {
+    std::string quoted = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c == '\n') {
+            quoted += "\\n";
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+// fields are printf formatted key=value pairs separated by spaces
+__attribute__((format(printf, 3, 4)))
+inline void write(Category category, const char* event, const char* fields, ...) {
+    va_list args;
+    va_start(args, fields);
+    va_list sizeArgs;
+    va_copy(sizeArgs, args);
+    int len = vsnprintf(nullptr, 0, fields, sizeArgs);
+    va_end(sizeArgs);
+    std::vector<char> formatted(len > 0 ? len + 1 : 1, '\0');
+    if (len > 0) {
+        vsnprintf(formatted.data(), formatted.size(), fields, args);
+    }
+    va_end(args);
+
+    char prefix[64];
+    snprintf(
+            prefix, sizeof(prefix), "category=%s tid=%zx event=", categoryName(category),
+            std::hash<std::thread::id>()(std::this_thread::get_id()) & 0xffff);
+    std::string line = prefix;
+    line += event;
+    if (len > 0) {
+        line += ' ';
+        line += formatted.data();
+    }
+    line += '\n';
+
+    static std::mutex m;
+    std::lock_guard<std::mutex> lk(m);
+    fputs(line.c_str(), stdout);
+    fflush(stdout);
+}
+
+}  // namespace debug_log
+
+// DEBUG_LOG(kStep, "act", "player=%d current=%d", player, current)
+#define DEBUG_LOG(category, event, ...)                                 \
+    do {                                                                \
+        if (debug_log::enabled(debug_log::category)) {                  \
+            debug_log::write(debug_log::category, event, __VA_ARGS__);  \
+        }                                                               \
+    } while (0)
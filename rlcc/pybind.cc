@@ -14,7 +14,10 @@
 #include "hanabi-learning-environment/hanabi_lib/hanabi_move.h"
 #include "hanabi-learning-environment/hanabi_lib/hanabi_observation.h"
 
+#include "rela/small_tensor_pool.h"
+#include "rela/trace.h"
 #include "rlcc/clone_data_generator.h"
+#include "rlcc/debug_log.h"
 #include "rlcc/hanabi_env.h"
 #include "rlcc/thread_loop.h"
 #include "rlcc/actors/actor.h"
@@ -144,12 +147,26 @@ PYBIND11_MODULE(hanalearn, m) {
 
     m.def("observe_sad", &observeSAD);
 
+    // e.g. "step,state,move", "all" or "" to turn off
+    m.def("set_debug_log", &debug_log::setCategories);
+
+    // bound here and not in rela, the pool state is per module and the
+    // guards are in this module's actor threads
+    m.def("enable_small_tensor_pool", &rela::SmallTensorPool::enable);
+    m.def("small_tensor_pool_stats", &rela::SmallTensorPool::stats);
+
+    // the actor threads' side of the trace, merged with rela's by train.py
+    m.def("trace_start", &rela::trace::start);
+    m.def("trace_stop", &rela::trace::stop);
+    m.def("trace_dump", &rela::trace::dump, py::arg("path"), py::arg("pid") = 1);
+
     py::class_<HanabiThreadLoop, rela::ThreadLoop, std::shared_ptr<HanabiThreadLoop>>(
             m, "HanabiThreadLoop")
         .def(py::init<
                 std::vector<std::shared_ptr<HanabiEnv>>,
                 std::vector<std::vector<std::shared_ptr<Actor>>>,
-                bool>());
+                bool>())
+        .def("num_env_step", &HanabiThreadLoop::numEnvStep);
 
     // bind some hanabi util classes
     py::class_<HanabiCard>(m, "HanabiCard")
@@ -9,11 +9,11 @@
 #include <stdio.h>
 #include <iostream>
 
+#include "rela/small_tensor_pool.h"
 #include "rela/thread_loop.h"
+#include "rela/trace.h"
 #include "rlcc/actors/actor.h"
-
-#define PR false
-#define ST false
+#include "rlcc/debug_log.h"
 
 class HanabiThreadLoop : public rela::ThreadLoop {
     public:
@@ -29,8 +29,19 @@ class HanabiThreadLoop : public rela::ThreadLoop {
               }
 
         virtual void mainLoop() override {
+            // obs, eps & action tensors of this thread come from its pool
+            rela::SmallTensorPoolGuard poolGuard;
+            RELA_TRACE_THREAD("actor_loop");
             while (!terminated()) {
-                if(PR)printf("\n=======================================\n");
+                // only compute_priority requests can outlive a step, they
+                // are waited for in beforePark
+                waitUntilResume();
+                if (terminated()) {
+                    break;
+                }
+                DEBUG_LOG(kStep, "step", "num_env=%zu", envs_.size());
+                RELA_TRACE_PHASES(step);
+                RELA_TRACE_NEXT(step, "reset");
 
                 // go over each envs in sequential order
                 // call in seperate for-loops to maximize parallization
@@ -55,35 +66,19 @@ class HanabiThreadLoop : public rela::ThreadLoop {
 
                         envs_[i]->reset();
                         for (size_t j = 0; j < actors.size(); ++j) {
-                            if(PR)printf("\n[player %ld resetting]\n", j);
+                            DEBUG_LOG(kStep, "reset", "env=%zu player=%zu", i, j);
                             actors[j]->reset(*envs_[i]);
                         }
                     }
                 }
 
-                if(ST)printf("\nScore: %d\n", envs_[0]->getScore());
-                if(ST)printf("Lives: %d\n", envs_[0]->getLife());
-                if(ST)printf("Information: %d\n", envs_[0]->getInfo());
-                auto deck = envs_[0]->getHleState().Deck();
-                if(ST)printf("Deck: %d\n", deck.Size());
-                std::string colours = "RYGWB";
-                auto fireworks = envs_[0]->getFireworks();
-                if(ST)printf("Fireworks: ");
-                for (unsigned long i = 0; i < colours.size(); i++)
-                    if(ST)printf("%c%d ", colours[i], fireworks[i]);
-                if(ST)printf("\n");
-                auto hands = envs_[0]->getHleState().Hands();
-                int cp = envs_[0]->getCurrentPlayer();
-                for(unsigned long i = 0; i < hands.size(); i++) {
-                    if(ST)printf("Actor %ld hand:%s\n", i,
-                        cp == (int)i ? " <-- current player" : ""); 
-                    auto hand = hands[i].ToString();
-                    hand.pop_back();
-                    if(ST)printf("%s\n", hand.c_str());
+                // only copies the state when the category is enabled
+                if (debug_log::enabled(debug_log::kState)) {
+                    logState(*envs_[0]);
                 }
 
-                if(PR)printf("\n----\n");
 
+                RELA_TRACE_NEXT(step, "observe_before_act");
                 // go over each envs in sequential order
                 // call in seperate for-loops to maximize parallization
                 for (size_t i = 0; i < envs_.size(); ++i) {
@@ -94,14 +89,13 @@ class HanabiThreadLoop : public rela::ThreadLoop {
                     auto& actors = actors_[i];
                     int curPlayer = envs_[i]->getCurrentPlayer();
                     for (size_t j = 0; j < actors.size(); ++j) {
-                        if(PR)
-                            printf("\n[player %ld observe before acting]%s\n", j,
-                            curPlayer == (int)j ? " <-- current player" : "");
+                        DEBUG_LOG(kStep, "observe_before_act", "env=%zu player=%zu current=%d",
+                                i, j, curPlayer == (int)j);
                         actors[j]->observeBeforeAct(*envs_[i]);
                     }
                 }
-                if(PR)printf("\n----\n");
 
+                RELA_TRACE_NEXT(step, "act");
                 for (size_t i = 0; i < envs_.size(); ++i) {
                     if (done_[i] == 1) {
                         continue;
@@ -110,34 +104,11 @@ class HanabiThreadLoop : public rela::ThreadLoop {
                     auto& actors = actors_[i];
                     int curPlayer = envs_[i]->getCurrentPlayer();
                     for (size_t j = 0; j < actors.size(); ++j) {
-                        if(PR)printf("\n[player %ld acting]%s\n", j, 
-                                curPlayer == (int)j ? " <-- current player" : "");
+                        DEBUG_LOG(kStep, "act", "env=%zu player=%zu current=%d",
+                                i, j, curPlayer == (int)j);
                         actors[j]->act(*envs_[i], curPlayer);
                     }
                 }
-                if(PR)printf("\n----\n");
-
-                //if(ST)printf("\nScore: %d\n", envs_[0]->getScore());
-                //if(ST)printf("Lives: %d\n", envs_[0]->getLife());
-                //if(ST)printf("Information: %d\n", envs_[0]->getInfo());
-                //deck = envs_[0]->getHleState().Deck();
-                //if(ST)printf("Deck: %d\n", deck.Size());
-                //colours = "RYGWB";
-                //fireworks = envs_[0]->getFireworks();
-                //if(ST)printf("Fireworks: ");
-                //for (unsigned long i = 0; i < colours.size(); i++)
-                    //if(ST)printf("%c%d ", colours[i], fireworks[i]);
-                //if(ST)printf("\n");
-                //hands = envs_[0]->getHleState().Hands();
-                //cp = envs_[0]->getCurrentPlayer();
-                //for(unsigned long i = 0; i < hands.size(); i++) {
-                    //if(ST)printf("Actor %ld hand:%s\n", i,
-                        //cp == (int)i ? " <-- current player" : ""); 
-                    //auto hand = hands[i].ToString();
-                    //hand.pop_back();
-                    //if(ST)printf("%s\n", hand.c_str());
-                //}
-                //if(PR)printf("\n----\n");
 
                 //for (size_t i = 0; i < envs_.size(); ++i) {
                     //if (done_[i] == 1) {
@@ -147,13 +118,14 @@ class HanabiThreadLoop : public rela::ThreadLoop {
                     //auto& actors = actors_[i];
                     //int curPlayer = envs_[i]->getCurrentPlayer();
                     //for (size_t j = 0; j < actors.size(); ++j) {
-                        //if(PR)printf("\n[player %ld fictious acting]%s\n", j,
-                                //curPlayer == (int)j ? " <-- current player" : "");
+                        //DEBUG_LOG(kStep, "fict_act", "env=%zu player=%zu current=%d", i, j,
+                                //curPlayer == (int)j);
                         //actors[j]->fictAct(*envs_[i]);
                     //}
                 //}
-                if(PR)printf("\n----\n");
 
+                RELA_TRACE_NEXT(step, "observe_after_act");
+                int numStep = 0;
                 for (size_t i = 0; i < envs_.size(); ++i) {
                     if (done_[i] == 1) {
                         continue;
@@ -162,18 +134,65 @@ class HanabiThreadLoop : public rela::ThreadLoop {
                     auto& actors = actors_[i];
                     int curPlayer = envs_[i]->getCurrentPlayer();
                     for (size_t j = 0; j < actors.size(); ++j) {
-                        if(PR)printf("\n[player %ld observe after acting]%s\n", j,
-                                curPlayer == (int)j ? " <-- current player" : "");
+                        DEBUG_LOG(kStep, "observe_after_act", "env=%zu player=%zu current=%d",
+                                i, j, curPlayer == (int)j);
                         actors[j]->observeAfterAct(*envs_[i]);
                     }
+                    ++numStep;
+                    if (envs_[i]->terminated()) {
+                        ++numEpisode_;
+                    }
+                }
+                numEnvStep_ += numStep;
+            }
+        }
+
+        // total number of env steps taken by this thread
+        int64_t numEnvStep() const {
+            return numEnvStep_;
+        }
+
+        // total number of finished games
+        int64_t numEpisode() const {
+            return numEpisode_;
+        }
+
+    protected:
+        void beforePark() override {
+            for (auto& actors : actors_) {
+                for (auto& actor : actors) {
+                    actor->flushPending();
                 }
             }
         }
 
     private:
+        void logState(const HanabiEnv& env) {
+            std::string colours = "RYGWB";
+            auto fireworks = env.getFireworks();
+            std::string fireworkStr;
+            for (size_t i = 0; i < colours.size(); ++i) {
+                fireworkStr += colours[i] + std::to_string(fireworks[i]);
+            }
+            DEBUG_LOG(kState, "state",
+                    "score=%d lives=%d info=%d deck=%d fireworks=%s current=%d",
+                    env.getScore(), env.getLife(), env.getInfo(),
+                    env.getHleState().Deck().Size(), fireworkStr.c_str(),
+                    env.getCurrentPlayer());
+            const auto& hands = env.getHleState().Hands();
+            for (size_t i = 0; i < hands.size(); ++i) {
+                auto hand = hands[i].ToString();
+                hand.pop_back();
+                DEBUG_LOG(kState, "hand", "player=%zu cards=%s", i,
+                        debug_log::quote(hand).c_str());
+            }
+        }
+
         std::vector<std::shared_ptr<HanabiEnv>> envs_;
         std::vector<std::vector<std::shared_ptr<Actor>>> actors_;
         std::vector<int8_t> done_;
         const bool eval_;
         int numDone_ = 0;
+        std::atomic<int64_t> numEnvStep_{0};
+        std::atomic<int64_t> numEpisode_{0};
 };
@@ -0,0 +1,36 @@
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "rlcc/tools/args.h"
+
+std::map<std::string, std::string> parseArgs(
+    int argc, char** argv, std::map<std::string, std::string> defaults) {
+  auto args = std::move(defaults);
+  for (int i = 1; i < argc; i += 2) {
+    std::string key = argv[i];
+    if (key.rfind("--", 0) != 0 || i + 1 >= argc) {
+      std::cerr << "Error: bad argument: " << key << std::endl;
+      exit(1);
+    }
+    key = key.substr(2);
+    if (args.find(key) == args.end()) {
+      std::cerr << "Error: unknown argument: --" << key << std::endl;
+      exit(1);
+    }
+    args[key] = argv[i + 1];
+  }
+  return args;
+}
+
+std::vector<int> parseIntList(const std::string& s) {
+  std::vector<int> vals;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    vals.push_back(std::stoi(item));
+  }
+  assert(vals.size() > 0);
+  return vals;
+}
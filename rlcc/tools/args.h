@@ -0,0 +1,13 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+// "--key value" arguments of the tools in rlcc/tools, over defaults. exits
+// with an error on a key that has no default
+std::map<std::string, std::string> parseArgs(
+    int argc, char** argv, std::map<std::string, std::string> defaults);
+
+// "1,2,4" -> {1, 2, 4}
+std::vector<int> parseIntList(const std::string& s);
@@ -0,0 +1,133 @@
+// Sweep num_thread, num_game_per_thread and the act/compute_priority batch
+// sizes on this machine and write the fastest config as json, which
+// pyhanabi/train.py and pyhanabi/eval.py read through --tune_config.
+//
+// usage:
+//   autotune --model agent.pt --device cuda:1 --out tune.json
+//       --num_thread 10,20 --num_game_per_thread 40,80
+//       --act_batchsize 1000,5000 --priority_batchsize 100 --seconds 10
+//
+// agent.pt is a scripted R2D2Agent saved with agent.save(path).
+//
+// target_batchsize is not swept: R2D2Actor never calls compute_target, so
+// the method's batch size has no effect on throughput. train.py keeps its
+// --target_batchsize.
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "rlcc/tools/args.h"
+#include "rlcc/tools/selfplay.h"
+
+namespace {
+
+struct Trial {
+  SelfPlayConfig cfg;
+  SelfPlayResult result;
+};
+
+std::map<std::string, std::string> parseAutotuneArgs(int argc, char** argv) {
+  auto args = parseArgs(
+      argc,
+      argv,
+      {
+          {"model", ""},
+          {"device", "cpu"},
+          {"out", "tune.json"},
+          {"num_thread", "10"},
+          {"num_game_per_thread", "20,40,80"},
+          {"act_batchsize", "1000,5000"},
+          {"priority_batchsize", "100"},
+          {"num_player", "2"},
+          {"max_len", "80"},
+          {"eps", "0.1"},
+          {"seed", "1"},
+          {"warmup", "3"},
+          {"seconds", "10"},
+      });
+  if (args["model"].empty()) {
+    std::cerr << "Error: --model is required" << std::endl;
+    exit(1);
+  }
+  return args;
+}
+
+void writeTrial(std::ostream& os, const Trial& trial, const std::string& indent) {
+  os << indent << "\"num_thread\": " << trial.cfg.numThread << ",\n"
+     << indent << "\"num_game_per_thread\": " << trial.cfg.numGamePerThread << ",\n"
+     << indent << "\"act_batchsize\": " << trial.cfg.actBatchsize << ",\n"
+     << indent << "\"priority_batchsize\": " << trial.cfg.priorityBatchsize << ",\n"
+     << indent << "\"env_step_per_sec\": " << trial.result.envStepPerSec << ",\n"
+     << indent << "\"act_batch_fill\": " << trial.result.actBatchFill << ",\n"
+     << indent << "\"priority_batch_fill\": " << trial.result.priorityBatchFill;
+}
+
+void writeJson(const std::string& path, const Trial& best, const std::vector<Trial>& trials) {
+  std::ofstream os(path);
+  os << "{\n";
+  writeTrial(os, best, "  ");
+  os << ",\n  \"trials\": [\n";
+  for (size_t i = 0; i < trials.size(); ++i) {
+    os << "    {\n";
+    writeTrial(os, trials[i], "      ");
+    os << "\n    }" << (i + 1 < trials.size() ? "," : "") << "\n";
+  }
+  os << "  ]\n}\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  auto args = parseAutotuneArgs(argc, argv);
+
+  auto model = std::make_shared<torch::jit::script::Module>(
+      torch::jit::load(args["model"], torch::Device(args["device"])));
+  model->eval();
+
+  SelfPlayConfig base;
+  base.numPlayer = std::stoi(args["num_player"]);
+  base.maxLen = std::stoi(args["max_len"]);
+  base.eps = std::stof(args["eps"]);
+  base.seed = std::stoi(args["seed"]);
+  base.device = args["device"];
+  double warmup = std::stod(args["warmup"]);
+  double seconds = std::stod(args["seconds"]);
+
+  std::vector<Trial> trials;
+  for (int numThread : parseIntList(args["num_thread"])) {
+    for (int numGame : parseIntList(args["num_game_per_thread"])) {
+      for (int actBs : parseIntList(args["act_batchsize"])) {
+        for (int priorityBs : parseIntList(args["priority_batchsize"])) {
+          Trial trial;
+          trial.cfg = base;
+          trial.cfg.numThread = numThread;
+          trial.cfg.numGamePerThread = numGame;
+          trial.cfg.actBatchsize = actBs;
+          trial.cfg.priorityBatchsize = priorityBs;
+          trial.result = runSelfPlay(model, trial.cfg, warmup, seconds);
+          std::cout << "num_thread: " << numThread << ", num_game_per_thread: " << numGame
+                    << ", act_batchsize: " << actBs
+                    << ", priority_batchsize: " << priorityBs
+                    << ", env_step/s: " << trial.result.envStepPerSec
+                    << ", act fill: " << trial.result.actBatchFill
+                    << " (" << trial.result.actBatchsize << ")"
+                    << ", priority fill: " << trial.result.priorityBatchFill
+                    << " (" << trial.result.priorityBatchsize << ")" << std::endl;
+          trials.push_back(trial);
+        }
+      }
+    }
+  }
+
+  auto best = std::max_element(trials.begin(), trials.end(), [](const Trial& a, const Trial& b) {
+    return a.result.envStepPerSec < b.result.envStepPerSec;
+  });
+  std::cout << "best: num_thread: " << best->cfg.numThread
+            << ", num_game_per_thread: " << best->cfg.numGamePerThread
+            << ", act_batchsize: " << best->cfg.actBatchsize
+            << ", priority_batchsize: " << best->cfg.priorityBatchsize
+            << ", env_step/s: " << best->result.envStepPerSec << std::endl;
+  writeJson(args["out"], *best, trials);
+  std::cout << "written to " << args["out"] << std::endl;
+  return 0;
+}
@@ -0,0 +1,305 @@
+// Microbenchmarks of the rela & rlcc hot paths, cpu only. Each benchmark
+// repeats one operation for --seconds and reports time and torch cpu
+// allocations per op, the results are written as json to --out.
+//
+// usage:
+//   microbench --out bench.json --seconds 2 --filter replay
+//       --capacity 4096,65536 --num_producer 1,4,16
+//
+// benchmarks:
+//   r2d2_buffer_episode  push a 40 step episode into R2D2Buffer & pop it
+//   make_batch_bs<B>     makeBatch of B transitions
+//   replay_cap<C>        sample(128) & updatePriority on a full replay
+//   batcher_p<N>         N threads send & wait on one Batcher, echo reply
+//   observe, observe_hide_action, observe_sad
+//   apply_move           random legal moves until the end of the game
+#include <c10/core/CPUAllocator.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "rela/batcher.h"
+#include "rela/prioritized_replay.h"
+#include "rela/r2d2.h"
+
+#include "rlcc/tools/args.h"
+#include "rlcc/tools/selfplay.h"
+#include "rlcc/utils.h"
+
+namespace {
+
+constexpr int kPrivDim = 783;
+constexpr int kPublDim = 658;
+constexpr int kNumAction = 21;
+constexpr int kSeqLen = 40;
+constexpr int kMaxSeqLen = 80;
+
+struct Result {
+  std::string name;
+  int64_t numOp = 0;
+  double nsPerOp = 0;
+  double opPerSec = 0;
+  double allocPerOp = 0;
+};
+
+// counts torch cpu allocations on top of the default allocator
+class CountingAllocator : public c10::Allocator {
+ public:
+  void install() {
+    base_ = c10::GetCPUAllocator();
+    c10::SetCPUAllocator(this, /*priority=*/2);
+  }
+
+  c10::DataPtr allocate(size_t nbytes) const override {
+    ++numAlloc;
+    return base_->allocate(nbytes);
+  }
+
+  c10::DeleterFnPtr raw_deleter() const override {
+    return base_->raw_deleter();
+  }
+
+  mutable std::atomic<int64_t> numAlloc{0};
+
+ private:
+  c10::Allocator* base_ = nullptr;
+};
+
+CountingAllocator& allocator() {
+  static CountingAllocator instance;
+  return instance;
+}
+
+// calls op in growing rounds until seconds have passed, op is run once
+// before measuring
+Result measure(const std::string& name, double seconds, const std::function<void()>& op) {
+  op();
+  int64_t numOp = 0;
+  int64_t round = 1;
+  int64_t allocBegin = allocator().numAlloc;
+  auto begin = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed(0);
+  while (elapsed.count() < seconds) {
+    for (int64_t i = 0; i < round; ++i) {
+      op();
+    }
+    numOp += round;
+    round *= 2;
+    elapsed = std::chrono::steady_clock::now() - begin;
+  }
+
+  Result result;
+  result.name = name;
+  result.numOp = numOp;
+  result.nsPerOp = elapsed.count() * 1e9 / numOp;
+  result.opPerSec = numOp / elapsed.count();
+  result.allocPerOp = (allocator().numAlloc - allocBegin) / (double)numOp;
+  return result;
+}
+
+rela::TensorDict randomObs() {
+  return {
+      {"priv_s", torch::rand({kPrivDim})},
+      {"publ_s", torch::rand({kPublDim})},
+      {"legal_move", torch::ones({kNumAction})},
+  };
+}
+
+rela::RNNTransition fillEpisode(rela::R2D2Buffer& buffer, const rela::TensorDict& obs) {
+  rela::TensorDict h0 = {{"h0", torch::zeros({2, 512})}, {"c0", torch::zeros({2, 512})}};
+  buffer.init(h0, {{"eps", torch::tensor(0.1f)}});
+  for (int t = 0; t < kSeqLen; ++t) {
+    buffer.pushObs(obs);
+    buffer.pushAction({{"a", torch::tensor(int64_t(t % kNumAction))}});
+    buffer.pushReward(0);
+    buffer.pushTerminal(t == kSeqLen - 1 ? 1.0f : 0.0f);
+  }
+  return buffer.popTransition();
+}
+
+std::vector<rela::RNNTransition> makeTransitions(int num) {
+  rela::R2D2Buffer buffer(1, kMaxSeqLen, 0.999);
+  std::vector<rela::RNNTransition> transitions;
+  for (int i = 0; i < num; ++i) {
+    transitions.push_back(fillEpisode(buffer, randomObs()));
+  }
+  return transitions;
+}
+
+// numProducer threads send one obs at a time & wait for the reply, a
+// consumer thread answers every batch with a [bsize] action
+Result benchBatcher(int numProducer, double seconds) {
+  rela::Batcher batcher(numProducer);
+  auto replySchema = rela::Schema::intern({"a"});
+  std::thread consumer([&] {
+    while (true) {
+      auto packed = batcher.getPacked();
+      if (packed.empty()) {
+        return;
+      }
+      auto bsize = packed.unpack()[0].size(0);
+      batcher.set(rela::TensorRecord(replySchema, {torch::zeros({bsize}, torch::kInt64)}));
+    }
+  });
+
+  std::atomic<bool> stop{false};
+  std::atomic<int64_t> numOp{0};
+  std::vector<std::thread> producers;
+  int64_t allocBegin = allocator().numAlloc;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < numProducer; ++i) {
+    producers.emplace_back([&] {
+      auto obs = randomObs();
+      while (!stop) {
+        auto reply = batcher.send(obs).getRecord();
+        assert(reply.size() == 1);
+        ++numOp;
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  for (auto& t : producers) {
+    t.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  batcher.exit();
+  consumer.join();
+
+  Result result;
+  result.name = "batcher_p" + std::to_string(numProducer);
+  result.numOp = numOp;
+  result.nsPerOp = elapsed.count() * 1e9 / numOp;
+  result.opPerSec = numOp / elapsed.count();
+  result.allocPerOp = (allocator().numAlloc - allocBegin) / (double)numOp;
+  return result;
+}
+
+// a state some random moves into the game, so that observe has hints,
+// discards & fireworks to encode
+hle::HanabiState midGameState(HanabiEnv& env, std::mt19937& rng) {
+  env.reset();
+  hle::HanabiState state = env.getHleState();
+  for (int i = 0; i < 20 && !state.IsTerminal(); ++i) {
+    auto legalMoves = state.LegalMoves(state.CurPlayer());
+    applyMove(state, legalMoves[rng() % legalMoves.size()], false);
+  }
+  return state;
+}
+
+void report(const Result& r, std::vector<Result>& results) {
+  std::cout << r.name << ": " << r.nsPerOp / 1000 << " us/op, " << r.opPerSec << " op/s, "
+            << r.allocPerOp << " alloc/op" << std::endl;
+  results.push_back(r);
+}
+
+void writeJson(const std::string& path, const std::vector<Result>& results) {
+  std::ofstream os(path);
+  os << "{\n  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    os << "    {\"name\": \"" << r.name << "\", \"num_op\": " << r.numOp
+       << ", \"ns_per_op\": " << r.nsPerOp << ", \"op_per_sec\": " << r.opPerSec
+       << ", \"alloc_per_op\": " << r.allocPerOp << "}"
+       << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  os << "  ]\n}\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  auto args = parseArgs(
+      argc,
+      argv,
+      {
+          {"out", "microbench.json"},
+          {"seconds", "2"},
+          {"filter", ""},
+          {"capacity", "4096,65536"},
+          {"batchsize", "32,128"},
+          {"num_producer", "1,4,16"},
+          {"seed", "1"},
+      });
+  double seconds = std::stod(args["seconds"]);
+  const std::string& filter = args["filter"];
+  std::mt19937 rng(std::stoi(args["seed"]));
+  torch::manual_seed(std::stoi(args["seed"]));
+  // like the actor threads, no intra-op parallelism
+  torch::set_num_threads(1);
+  allocator().install();
+
+  std::vector<Result> results;
+  auto run = [&](const std::string& name, const std::function<void()>& op) {
+    if (name.find(filter) == std::string::npos) {
+      return;
+    }
+    report(measure(name, seconds, op), results);
+  };
+
+  {
+    rela::R2D2Buffer buffer(1, kMaxSeqLen, 0.999);
+    auto obs = randomObs();
+    run("r2d2_buffer_episode", [&] { fillEpisode(buffer, obs); });
+  }
+
+  for (int batchsize : parseIntList(args["batchsize"])) {
+    std::string name = "make_batch_bs" + std::to_string(batchsize);
+    if (name.find(filter) == std::string::npos) {
+      continue;
+    }
+    auto transitions = makeTransitions(batchsize);
+    run(name, [&] { rela::makeBatch(transitions, "cpu"); });
+  }
+
+  for (int capacity : parseIntList(args["capacity"])) {
+    std::string name = "replay_cap" + std::to_string(capacity);
+    if (name.find(filter) == std::string::npos) {
+      continue;
+    }
+    rela::RNNPrioritizedReplay replay(capacity, std::stoi(args["seed"]), 0.9, 0.6, 0);
+    // replay elements share tensors, sampling still copies them into a batch
+    auto transitions = makeTransitions(64);
+    for (int i = 0; i < capacity; ++i) {
+      replay.add(transitions[i % transitions.size()], 1.0);
+    }
+    run(name, [&] {
+      replay.sample(128, "cpu");
+      replay.updatePriority(torch::rand({128}));
+    });
+  }
+
+  for (int numProducer : parseIntList(args["num_producer"])) {
+    std::string name = "batcher_p" + std::to_string(numProducer);
+    if (name.find(filter) == std::string::npos) {
+      continue;
+    }
+    report(benchBatcher(numProducer, seconds), results);
+  }
+
+  auto env = createEnvs(1, std::stoi(args["seed"]), 2, kMaxSeqLen)[0];
+  auto state = midGameState(*env, rng);
+  run("observe", [&] { observe(state, state.CurPlayer(), false); });
+  run("observe_hide_action", [&] { observe(state, state.CurPlayer(), true); });
+  run("observe_sad", [&] { observeSAD(state, state.CurPlayer()); });
+
+  env->reset();
+  const hle::HanabiState initState = env->getHleState();
+  hle::HanabiState playState = initState;
+  run("apply_move", [&] {
+    if (playState.IsTerminal()) {
+      playState = initState;
+    }
+    auto legalMoves = playState.LegalMoves(playState.CurPlayer());
+    applyMove(playState, legalMoves[rng() % legalMoves.size()], false);
+  });
+
+  writeJson(args["out"], results);
+  std::cout << "written to " << args["out"] << std::endl;
+  return 0;
+}
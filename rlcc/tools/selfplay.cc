@@ -0,0 +1,194 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "rela/context.h"
+#include "rela/prioritized_replay.h"
+
+#include "rlcc/actors/r2d2_actor.h"
+#include "rlcc/thread_loop.h"
+#include "rlcc/tools/selfplay.h"
+
+namespace {
+
+struct Counter {
+  int64_t envStep = 0;
+  int64_t episode = 0;
+  int64_t replayAdd = 0;
+  int64_t replaySample = 0;
+  int64_t actBatch = 0;
+  int64_t actData = 0;
+  int64_t priorityBatch = 0;
+  int64_t priorityData = 0;
+};
+
+Counter getCounter(
+    const std::vector<std::shared_ptr<HanabiThreadLoop>>& loops,
+    const rela::BatchRunner& runner,
+    const rela::BatchRunner& partnerRunner,
+    const rela::RNNPrioritizedReplay& replay,
+    const std::atomic<int64_t>& numSample) {
+  Counter counter;
+  for (const auto& loop : loops) {
+    counter.envStep += loop->numEnvStep();
+    counter.episode += loop->numEpisode();
+  }
+  counter.replayAdd = replay.numAdd();
+  counter.replaySample = numSample;
+  std::tie(counter.actBatch, counter.actData) = runner.batchCount("act");
+  int64_t partnerBatch, partnerData;
+  std::tie(partnerBatch, partnerData) = partnerRunner.batchCount("act");
+  counter.actBatch += partnerBatch;
+  counter.actData += partnerData;
+  std::tie(counter.priorityBatch, counter.priorityData) =
+      runner.batchCount("compute_priority");
+  return counter;
+}
+
+float meanBatchsize(int64_t numBatch, int64_t numData) {
+  if (numBatch == 0) {
+    return 0;
+  }
+  return numData / (float)numBatch;
+}
+
+}  // namespace
+
+std::vector<std::shared_ptr<HanabiEnv>> createEnvs(
+    int numEnv, int seed, int numPlayer, int maxLen) {
+  std::vector<std::shared_ptr<HanabiEnv>> envs;
+  for (int i = 0; i < numEnv; ++i) {
+    std::unordered_map<std::string, std::string> params = {
+        {"players", std::to_string(numPlayer)},
+        {"seed", std::to_string(seed + i)},
+        {"bomb", "0"},
+        {"hand_size", "5"},
+        {"random_start_player", "1"},
+    };
+    envs.push_back(std::make_shared<HanabiEnv>(params, maxLen, false));
+  }
+  return envs;
+}
+
+SelfPlayResult runSelfPlay(
+    std::shared_ptr<torch::jit::script::Module> model,
+    const SelfPlayConfig& cfg,
+    double warmupSec,
+    double durationSec) {
+  auto runner = std::make_shared<rela::BatchRunner>(model, cfg.device);
+  runner->addMethod("act", cfg.actBatchsize);
+  runner->addMethod("compute_priority", cfg.priorityBatchsize);
+  runner->start();
+  // the partners act through their own runner on a copy of the model
+  auto partnerModel = std::make_shared<torch::jit::script::Module>(model->clone());
+  auto partnerRunner = std::make_shared<rela::BatchRunner>(partnerModel, cfg.device);
+  partnerRunner->addMethod("act", cfg.actBatchsize);
+  partnerRunner->start();
+
+  // training mode actors need a replay buffer, useExperience = false keeps
+  // it empty
+  bool useReplay = cfg.replayCapacity > 0;
+  auto replay = std::make_shared<rela::RNNPrioritizedReplay>(
+      useReplay ? cfg.replayCapacity : 1, cfg.seed, 0.9, 0.6, 0);
+
+  auto envs =
+      createEnvs(cfg.numThread * cfg.numGamePerThread, cfg.seed, cfg.numPlayer, cfg.maxLen);
+  auto context = std::make_unique<rela::Context>();
+  std::vector<std::shared_ptr<HanabiThreadLoop>> loops;
+  int seed = cfg.seed;
+  for (int i = 0; i < cfg.numThread; ++i) {
+    std::vector<std::shared_ptr<HanabiEnv>> threadEnvs;
+    std::vector<std::vector<std::shared_ptr<Actor>>> threadActors;
+    for (int j = 0; j < cfg.numGamePerThread; ++j) {
+      threadEnvs.push_back(envs[i * cfg.numGamePerThread + j]);
+      std::vector<std::shared_ptr<Actor>> gameActors;
+      gameActors.push_back(std::make_shared<R2D2Actor>(
+          runner,
+          seed++,
+          cfg.numPlayer,
+          0,  // playerIdx
+          std::vector<float>{cfg.eps},
+          std::vector<float>(),
+          false,  // vdn
+          false,  // sad
+          false,  // shuffleColor
+          false,  // hideAction
+          true,   // trinary
+          replay,
+          1,  // multiStep
+          cfg.maxLen,
+          0.999,  // gamma
+          std::vector<std::vector<std::string>>(),
+          false,        // conventionSender
+          false,        // conventionOverride
+          false,        // conventionFictitiousOverride
+          useReplay));  // useExperience
+      for (int k = 1; k < cfg.numPlayer; ++k) {
+        gameActors.push_back(std::make_shared<R2D2Actor>(
+            partnerRunner,
+            cfg.numPlayer,
+            k,
+            false,  // vdn
+            false,  // sad
+            false,  // hideAction
+            std::vector<std::vector<std::string>>(),
+            false,    // conventionSender
+            false));  // conventionOverride
+      }
+      threadActors.push_back(gameActors);
+    }
+    auto loop = std::make_shared<HanabiThreadLoop>(threadEnvs, threadActors, false);
+    context->pushThreadLoop(loop);
+    loops.push_back(loop);
+  }
+  context->start();
+
+  // stands in for the learner, without it a full replay blocks the actors
+  std::atomic<bool> stopLearner{false};
+  std::atomic<int64_t> numSample{0};
+  std::thread learner;
+  if (useReplay) {
+    learner = std::thread([&] {
+      while (!stopLearner) {
+        if (replay->size() < cfg.trainBatchsize) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          continue;
+        }
+        replay->sample(cfg.trainBatchsize, "cpu");
+        replay->updatePriority(torch::ones({cfg.trainBatchsize}));
+        numSample += cfg.trainBatchsize;
+      }
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(warmupSec));
+  auto begin = getCounter(loops, *runner, *partnerRunner, *replay, numSample);
+  auto beginTime = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(durationSec));
+  auto end = getCounter(loops, *runner, *partnerRunner, *replay, numSample);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - beginTime;
+
+  stopLearner = true;
+  if (learner.joinable()) {
+    learner.join();
+  }
+  // unblocks actors waiting for space in the replay
+  replay->terminate();
+  // terminate & join the actor threads before the runner goes away
+  context = nullptr;
+  runner->stop();
+  partnerRunner->stop();
+
+  SelfPlayResult result;
+  result.envStepPerSec = (end.envStep - begin.envStep) / elapsed.count();
+  result.episodePerSec = (end.episode - begin.episode) / elapsed.count();
+  result.replayAddPerSec = (end.replayAdd - begin.replayAdd) / elapsed.count();
+  result.replaySamplePerSec = (end.replaySample - begin.replaySample) / elapsed.count();
+  result.actBatchsize =
+      meanBatchsize(end.actBatch - begin.actBatch, end.actData - begin.actData);
+  result.actBatchFill = result.actBatchsize / cfg.actBatchsize;
+  result.priorityBatchsize = meanBatchsize(
+      end.priorityBatch - begin.priorityBatch, end.priorityData - begin.priorityData);
+  result.priorityBatchFill = result.priorityBatchsize / cfg.priorityBatchsize;
+  return result;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rela/batch_runner.h"
+
+#include "rlcc/hanabi_env.h"
+
+struct SelfPlayConfig {
+  int numThread = 1;
+  int numGamePerThread = 1;
+  int numPlayer = 2;
+  int maxLen = 80;
+  int actBatchsize = 5000;
+  int priorityBatchsize = 100;
+  float eps = 0.1;
+  int seed = 1;
+  std::string device = "cpu";
+  // > 0 stores the episodes in a replay of this capacity, which a learner
+  // thread samples trainBatchsize from & updates priorities as fast as it can
+  int replayCapacity = 0;
+  int trainBatchsize = 128;
+};
+
+struct SelfPlayResult {
+  double envStepPerSec = 0;
+  double episodePerSec = 0;
+  // episodes added to & sampled from the replay, 0 without replay
+  double replayAddPerSec = 0;
+  double replaySamplePerSec = 0;
+  // mean batchsize of each method, and that divided by the max batchsize
+  float actBatchsize = 0;
+  float actBatchFill = 0;
+  float priorityBatchsize = 0;
+  float priorityBatchFill = 0;
+};
+
+std::vector<std::shared_ptr<HanabiEnv>> createEnvs(
+    int numEnv, int seed, int numPlayer, int maxLen);
+
+// self-play in the same layout as pyhanabi/act_group.py: player 0 of every
+// game is a training mode R2D2Actor on a BatchRunner with act &
+// compute_priority, the other players are eval mode R2D2Actors on a second
+// runner with act only, serving a copy of model. Episodes go through
+// compute_priority and are only stored if cfg.replayCapacity > 0. Counters
+// are measured over the last durationSec, the act ones over both runners.
+SelfPlayResult runSelfPlay(
+    std::shared_ptr<torch::jit::script::Module> model,
+    const SelfPlayConfig& cfg,
+    double warmupSec,
+    double durationSec);
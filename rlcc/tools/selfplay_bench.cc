@@ -0,0 +1,100 @@
+// End to end cpu self-play throughput of HanabiThreadLoop, R2D2Actor,
+// BatchRunner & RNNPrioritizedReplay with a synthetic TorchScript LSTM in
+// place of a trained agent, so that actor side scaling can be measured on
+// any machine. Runs each --num_thread for --seconds and writes the results
+// as json to --out.
+//
+// usage:
+//   selfplay_bench --num_thread 1,2,4,8 --num_game_per_thread 20
+//       --replay_capacity 16384 --seconds 10 --out selfplay.json
+//
+// --replay_capacity 0 runs without storing episodes.
+#include <fstream>
+#include <iostream>
+
+#include "rlcc/tools/args.h"
+#include "rlcc/tools/selfplay.h"
+#include "rlcc/tools/synthetic_model.h"
+#include "rlcc/utils.h"
+
+int main(int argc, char** argv) {
+  auto args = parseArgs(
+      argc,
+      argv,
+      {
+          {"out", "selfplay.json"},
+          {"num_thread", "1,2,4,8"},
+          {"num_game_per_thread", "20"},
+          {"act_batchsize", "0"},
+          {"priority_batchsize", "100"},
+          {"replay_capacity", "16384"},
+          {"train_batchsize", "128"},
+          {"hid_dim", "512"},
+          {"num_lstm_layer", "2"},
+          {"num_player", "2"},
+          {"max_len", "80"},
+          {"eps", "0.1"},
+          {"seed", "1"},
+          {"warmup", "3"},
+          {"seconds", "10"},
+      });
+
+  SelfPlayConfig base;
+  base.numGamePerThread = std::stoi(args["num_game_per_thread"]);
+  base.priorityBatchsize = std::stoi(args["priority_batchsize"]);
+  base.replayCapacity = std::stoi(args["replay_capacity"]);
+  base.trainBatchsize = std::stoi(args["train_batchsize"]);
+  base.numPlayer = std::stoi(args["num_player"]);
+  base.maxLen = std::stoi(args["max_len"]);
+  base.eps = std::stof(args["eps"]);
+  base.seed = std::stoi(args["seed"]);
+  double warmup = std::stod(args["warmup"]);
+  double seconds = std::stod(args["seconds"]);
+
+  // input sizes as seen by the actors
+  auto env = createEnvs(1, base.seed, base.numPlayer, base.maxLen)[0];
+  env->reset();
+  auto obs = observe(env->getHleState(), 0, false);
+  int privDim = obs.at("priv_s").size(0);
+  int numAction = obs.at("legal_move").size(0);
+  auto model = createSyntheticR2D2(
+      privDim,
+      numAction,
+      std::stoi(args["hid_dim"]),
+      std::stoi(args["num_lstm_layer"]),
+      base.seed);
+
+  std::ofstream os(args["out"]);
+  os << "{\n  \"runs\": [\n";
+  auto numThreads = parseIntList(args["num_thread"]);
+  for (size_t i = 0; i < numThreads.size(); ++i) {
+    SelfPlayConfig cfg = base;
+    cfg.numThread = numThreads[i];
+    // by default every actor can be served by one act call
+    cfg.actBatchsize = std::stoi(args["act_batchsize"]);
+    if (cfg.actBatchsize <= 0) {
+      cfg.actBatchsize = cfg.numThread * cfg.numGamePerThread * cfg.numPlayer;
+    }
+    auto result = runSelfPlay(model, cfg, warmup, seconds);
+    std::cout << "num_thread: " << cfg.numThread << ", env_step/s: " << result.envStepPerSec
+              << ", episode/s: " << result.episodePerSec
+              << ", act fill: " << result.actBatchFill << " (" << result.actBatchsize << ")"
+              << ", priority fill: " << result.priorityBatchFill
+              << ", replay add/s: " << result.replayAddPerSec
+              << ", replay sample/s: " << result.replaySamplePerSec << std::endl;
+
+    os << "    {\"num_thread\": " << cfg.numThread
+       << ", \"num_game_per_thread\": " << cfg.numGamePerThread
+       << ", \"act_batchsize\": " << cfg.actBatchsize
+       << ", \"env_step_per_sec\": " << result.envStepPerSec
+       << ", \"episode_per_sec\": " << result.episodePerSec
+       << ", \"act_batch_fill\": " << result.actBatchFill
+       << ", \"priority_batch_fill\": " << result.priorityBatchFill
+       << ", \"replay_add_per_sec\": " << result.replayAddPerSec
+       << ", \"replay_sample_per_sec\": " << result.replaySamplePerSec << "}"
+       << (i + 1 < numThreads.size() ? "," : "") << "\n";
+  }
+  os << "  ]\n}\n";
+  std::cout << "written to " << args["out"] << std::endl;
+  return 0;
+}
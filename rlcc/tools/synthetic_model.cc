@@ -0,0 +1,103 @@
+#include <cmath>
+
+#include "rlcc/tools/synthetic_model.h"
+
+namespace {
+
+// hid is [batch, num_layer, num_player, dim] in act's input & output and
+// [batch, num_layer, 1, dim] in compute_priority's, like R2D2Net. the lstm
+// weights of all layers are stacked so that the layers can be looped over
+const char* kSource = R"JIT(
+def get_h0(self, batchsize: int) -> Dict[str, Tensor]:
+    num_layer = self.w_ih.size(0)
+    hid_dim = self.w_hh.size(1)
+    h0 = torch.zeros(num_layer, batchsize, hid_dim)
+    c0 = torch.zeros(num_layer, batchsize, hid_dim)
+    return {"h0": h0, "c0": c0}
+
+def lstm_step(self, x: Tensor, h0: Tensor, c0: Tensor) -> Tuple[Tensor, Tensor, Tensor]:
+    hs: List[Tensor] = []
+    cs: List[Tensor] = []
+    for i in range(self.w_ih.size(0)):
+        gates = torch.mm(x, self.w_ih[i]) + torch.mm(h0[i], self.w_hh[i]) + self.b[i]
+        chunks = gates.chunk(4, 1)
+        c = torch.sigmoid(chunks[1]) * c0[i] + torch.sigmoid(chunks[0]) * torch.tanh(chunks[2])
+        h = torch.sigmoid(chunks[3]) * torch.tanh(c)
+        hs.append(h)
+        cs.append(c)
+        x = h
+    return x, torch.stack(hs, 0), torch.stack(cs, 0)
+
+def q_value(self, priv_s: Tensor, h0: Tensor, c0: Tensor) -> Tuple[Tensor, Tensor, Tensor]:
+    x = torch.relu(torch.mm(priv_s, self.w_in))
+    o, h, c = self.lstm_step(x, h0, c0)
+    return torch.mm(o, self.w_q), h, c
+
+def act(self, obs: Dict[str, Tensor]) -> Dict[str, Tensor]:
+    priv_s = obs["priv_s"]
+    legal_move = obs["legal_move"]
+    bsize = priv_s.size(0)
+    eps = obs["eps"].flatten(0, 1)
+    h0 = obs["h0"].transpose(0, 1).flatten(1, 2).contiguous()
+    c0 = obs["c0"].transpose(0, 1).flatten(1, 2).contiguous()
+
+    q, h, c = self.q_value(priv_s, h0, c0)
+    legal_q = q - (1 - legal_move) * 1e10
+    greedy_action = legal_q.argmax(1)
+    random_action = legal_move.multinomial(1).squeeze(1)
+    rand = torch.rand(greedy_action.size())
+    action = torch.where(rand < eps, random_action, greedy_action)
+
+    hid_shape = [h.size(0), bsize, -1, h.size(2)]
+    return {
+        "a": action,
+        "h0": h.view(hid_shape).transpose(0, 1),
+        "c0": c.view(hid_shape).transpose(0, 1),
+    }
+
+def compute_priority(self, input_: Dict[str, Tensor]) -> Dict[str, Tensor]:
+    # [batch, seq, ...] -> [seq, batch, ...]
+    priv_s = input_["priv_s"].transpose(0, 1)
+    action = input_["a"].transpose(0, 1)
+    reward = input_["reward"].transpose(0, 1)
+    bootstrap = input_["bootstrap"].transpose(0, 1)
+    seq_len = input_["seq_len"]
+    bsize = priv_s.size(1)
+    if "h0" in input_:
+        h = input_["h0"].transpose(0, 1).flatten(1, 2).contiguous()
+        c = input_["c0"].transpose(0, 1).flatten(1, 2).contiguous()
+    else:
+        hid = self.get_h0(bsize)
+        h = hid["h0"]
+        c = hid["c0"]
+
+    qas: List[Tensor] = []
+    for t in range(priv_s.size(0)):
+        q, h, c = self.q_value(priv_s[t], h, c)
+        qas.append(q.gather(1, action[t].view(-1, 1).long()).squeeze(1))
+    qa = torch.stack(qas, 0)
+    next_qa = torch.cat([qa[1:], torch.zeros_like(qa[:1])], 0)
+    err = (reward + bootstrap * 0.999 * next_qa - qa).abs()
+    mask = (torch.arange(0, qa.size(0)).unsqueeze(1) < seq_len.unsqueeze(0)).float()
+    priority = (err * mask).sum(0) / seq_len
+    return {"priority": priority.detach()}
+)JIT";
+
+}  // namespace
+
+std::shared_ptr<torch::jit::script::Module> createSyntheticR2D2(
+    int privDim, int numAction, int hidDim, int numLstmLayer, int seed) {
+  torch::manual_seed(seed);
+  auto model = std::make_shared<torch::jit::script::Module>("SyntheticR2D2");
+  float scale = 1.0f / std::sqrt((float)hidDim);
+  model->register_parameter("w_in", torch::randn({privDim, hidDim}) * scale, false);
+  model->register_parameter(
+      "w_ih", torch::randn({numLstmLayer, hidDim, 4 * hidDim}) * scale, false);
+  model->register_parameter(
+      "w_hh", torch::randn({numLstmLayer, hidDim, 4 * hidDim}) * scale, false);
+  model->register_parameter("b", torch::zeros({numLstmLayer, 4 * hidDim}), false);
+  model->register_parameter("w_q", torch::randn({hidDim, numAction}) * scale, false);
+  model->define(kSource);
+  model->eval();
+  return model;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <memory>
+
+#include <torch/extension.h>
+
+// a randomly initialized TorchScript R2D2 agent with the get_h0, act and
+// compute_priority methods of pyhanabi/r2d2.py: a relu layer on priv_s
+// followed by an LSTM and a linear q head. it is only meant for measuring
+// throughput without a GPU or a trained model, the actions are not useful.
+// priv_s has privDim features and legal_move numAction
+std::shared_ptr<torch::jit::script::Module> createSyntheticR2D2(
+    int privDim, int numAction, int hidDim, int numLstmLayer, int seed);
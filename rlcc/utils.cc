@@ -33,7 +33,20 @@ std::tuple<float, bool> applyMove(
     return {reward, terminal};
 }
 
-rela::TensorDict observe(
+namespace {
+
+// the features of observe(), ownHandArIn & privArV0 are only set without
+// trinary
+struct Features {
+    torch::Tensor privS;
+    torch::Tensor publS;
+    torch::Tensor ownHand;
+    torch::Tensor ownHandArIn;
+    torch::Tensor privArV0;
+    torch::Tensor legalMove;
+};
+
+Features encodeFeatures(
         const hle::HanabiState& state,
         int playerIdx,
         bool shuffleColor,
@@ -56,19 +69,20 @@ rela::TensorDict observe(
             invColorPermute,
             hideAction);
 
-    rela::TensorDict feat;
+    Features feat;
     if (!sad) {
-        feat = splitPrivatePublic(vS, game);
+        std::tie(feat.privS, feat.publS) = splitPrivatePublicTensors(vS, game);
     } else {
         // only for evaluation
         auto vA =
             encoder.EncodeLastAction(obs, std::vector<int>(), shuffleColor, colorPermute);
-        feat = convertSad(vS, vA, game);
+        std::tie(feat.privS, feat.publS) =
+            splitPrivatePublicTensors(sadFeature(vS, vA, game), game);
     }
 
     if (trinary) {
         auto vOwnHand = encoder.EncodeOwnHandTrinary(obs);
-        feat["own_hand"] = torch::tensor(vOwnHand);
+        feat.ownHand = torch::tensor(vOwnHand);
     } else {
         auto vOwnHand = encoder.EncodeOwnHand(obs, shuffleColor, colorPermute);
         std::vector<float> vOwnHandARIn(vOwnHand.size(), 0);
@@ -77,11 +91,11 @@ rela::TensorDict observe(
                 vOwnHand.begin(),
                 vOwnHand.begin() + end,
                 vOwnHandARIn.begin() + game.NumColors() * game.NumRanks());
-        feat["own_hand"] = torch::tensor(vOwnHand);
-        feat["own_hand_ar_in"] = torch::tensor(vOwnHandARIn);
+        feat.ownHand = torch::tensor(vOwnHand);
+        feat.ownHandArIn = torch::tensor(vOwnHandARIn);
         auto privARV0 =
             encoder.EncodeARV0Belief(obs, std::vector<int>(), shuffleColor, colorPermute);
-        feat["priv_ar_v0"] = torch::tensor(privARV0);
+        feat.privArV0 = torch::tensor(privARV0);
     }
 
     // legal moves
@@ -100,10 +114,88 @@ rela::TensorDict observe(
         vLegalMove[game.MaxMoves()] = 1;
     }
 
-    feat["legal_move"] = torch::tensor(vLegalMove);
+    feat.legalMove = torch::tensor(vLegalMove);
     return feat;
 }
 
+}  // namespace
+
+rela::TensorDict observe(
+        const hle::HanabiState& state,
+        int playerIdx,
+        bool shuffleColor,
+        const std::vector<int>& colorPermute,
+        const std::vector<int>& invColorPermute,
+        bool hideAction,
+        bool trinary,
+        bool sad) {
+    auto feat = encodeFeatures(
+            state, playerIdx, shuffleColor, colorPermute, invColorPermute, hideAction,
+            trinary, sad);
+    rela::TensorDict dict = {
+        {"priv_s", feat.privS},
+        {"publ_s", feat.publS},
+        {"own_hand", feat.ownHand},
+        {"legal_move", feat.legalMove},
+    };
+    if (!trinary) {
+        dict["own_hand_ar_in"] = feat.ownHandArIn;
+        dict["priv_ar_v0"] = feat.privArV0;
+    }
+    return dict;
+}
+
+std::vector<std::string> ObserveIndex::keys(bool trinary) {
+    std::vector<std::string> keys = {"priv_s", "publ_s", "own_hand", "legal_move"};
+    if (!trinary) {
+        keys.push_back("own_hand_ar_in");
+        keys.push_back("priv_ar_v0");
+    }
+    return keys;
+}
+
+ObserveIndex::ObserveIndex(const rela::Schema& schema, bool trinary) {
+    privS = schema.indexOf("priv_s");
+    publS = schema.indexOf("publ_s");
+    ownHand = schema.indexOf("own_hand");
+    legalMove = schema.indexOf("legal_move");
+    fields = {privS, publS, ownHand, legalMove};
+    if (!trinary) {
+        ownHandArIn = schema.indexOf("own_hand_ar_in");
+        privArV0 = schema.indexOf("priv_ar_v0");
+        fields.push_back(ownHandArIn);
+        fields.push_back(privArV0);
+    }
+    for (int i : fields) {
+        assert(i >= 0);
+        (void)i;
+    }
+}
+
+void observe(
+        const hle::HanabiState& state,
+        int playerIdx,
+        bool shuffleColor,
+        const std::vector<int>& colorPermute,
+        const std::vector<int>& invColorPermute,
+        bool hideAction,
+        bool trinary,
+        bool sad,
+        const ObserveIndex& index,
+        rela::TensorRecord& out) {
+    auto feat = encodeFeatures(
+            state, playerIdx, shuffleColor, colorPermute, invColorPermute, hideAction,
+            trinary, sad);
+    out[index.privS] = feat.privS;
+    out[index.publS] = feat.publS;
+    out[index.ownHand] = feat.ownHand;
+    out[index.legalMove] = feat.legalMove;
+    if (!trinary) {
+        out[index.ownHandArIn] = feat.ownHandArIn;
+        out[index.privArV0] = feat.privArV0;
+    }
+}
+
 std::tuple<rela::TensorDict, std::vector<int>, std::vector<float>> beliefModelObserve(
         const hle::HanabiState& state,
         int playerIdx,
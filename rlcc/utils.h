@@ -13,6 +13,7 @@
 
 #include "rela/batch_runner.h"
 #include "rela/tensor_dict.h"
+#include "rela/tensor_record.h"
 
 namespace hle = hanabi_learning_env;
 
@@ -24,17 +25,25 @@ inline hle::HanabiCardValue indexToCard(int index, int numRank) {
     return hle::HanabiCardValue(index / numRank, index % numRank);
 }
 
-inline rela::TensorDict splitPrivatePublic(
+// priv_s, publ_s
+inline std::pair<torch::Tensor, torch::Tensor> splitPrivatePublicTensors(
         const std::vector<float>& feat, const hle::HanabiGame& game) {
     int bitsPerHand = game.HandSize() * game.NumColors() * game.NumRanks();
     // remove my hand, should be zero anyway
     std::vector<float> vPriv(feat.begin() + bitsPerHand, feat.end());
     // remove all private observation
     std::vector<float> vPubl(feat.begin() + bitsPerHand * game.NumPlayers(), feat.end());
-    return {{"priv_s", torch::tensor(vPriv)}, {"publ_s", torch::tensor(vPubl)}};
+    return {torch::tensor(vPriv), torch::tensor(vPubl)};
 }
 
-inline rela::TensorDict convertSad(
+inline rela::TensorDict splitPrivatePublic(
+        const std::vector<float>& feat, const hle::HanabiGame& game) {
+    auto [privS, publS] = splitPrivatePublicTensors(feat, game);
+    return {{"priv_s", privS}, {"publ_s", publS}};
+}
+
+// feat with my hand zeroed & the sad last action appended
+inline std::vector<float> sadFeature(
         const std::vector<float>& feat,
         const std::vector<float>& sad,
         const hle::HanabiGame& game) {
@@ -42,7 +51,14 @@ inline rela::TensorDict convertSad(
     std::vector<float> vPriv = feat;
     std::fill(vPriv.begin(), vPriv.begin() + bitsPerHand, 0);
     vPriv.insert(vPriv.end(), sad.begin(), sad.end());
-    auto ret = splitPrivatePublic(vPriv, game);
+    return vPriv;
+}
+
+inline rela::TensorDict convertSad(
+        const std::vector<float>& feat,
+        const std::vector<float>& sad,
+        const hle::HanabiGame& game) {
+    auto ret = splitPrivatePublic(sadFeature(feat, sad, game), game);
     // // for compatibility with legacy model
     // ret["s"] = torch::tensor(vPriv);
     return ret;
@@ -62,6 +78,40 @@ rela::TensorDict observe(
         bool trinary,
         bool sad);
 
+// indices of observe()'s features in a record schema, looked up once so
+// that observing into a record does not hash the feature names every step
+struct ObserveIndex {
+    ObserveIndex() = default;
+    ObserveIndex(const rela::Schema& schema, bool trinary);
+
+    // names of the features for the trinary flag, e.g. to intern a schema
+    static std::vector<std::string> keys(bool trinary);
+
+    int privS = -1;
+    int publS = -1;
+    int ownHand = -1;
+    // only without trinary
+    int ownHandArIn = -1;
+    int privArV0 = -1;
+    int legalMove = -1;
+    // every index above that is set, in the order of keys()
+    std::vector<int> fields;
+};
+
+// same as observe() but the features are written into out by index, out's
+// schema must have every field of ObserveIndex::keys(trinary)
+void observe(
+        const hle::HanabiState& state,
+        int playerIdx,
+        bool shuffleColor,
+        const std::vector<int>& colorPermute,
+        const std::vector<int>& invColorPermute,
+        bool hideAction,
+        bool trinary,
+        bool sad,
+        const ObserveIndex& index,
+        rela::TensorRecord& out);
+
 inline rela::TensorDict observe(
         const hle::HanabiState& state, int playerIdx, bool hideAction) {
     return observe(